@@ -0,0 +1,52 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+
+/*
+ * Minimal timing harness of the benchmarks.
+ *
+ * measure() runs a function a number of times and prints the time and heap
+ *  allocations per run, plus the throughput when the bytes processed per run
+ *  are given. Allocations are counted by the global operator new of the
+ *  benchmark program, see main.cpp.
+ */
+
+// Heap allocations made so far by the program
+size_t allocations();
+
+extern void const * volatile benchSink;
+
+// Keep the optimizer from dropping the computation of @p v
+template<typename T>
+inline void keep(T const & v)
+{
+    benchSink = &v;
+}
+
+template<typename F>
+void measure(char const * name, size_t runs, F && f, size_t bytes = 0)
+{
+    f(); // warm up caches and lazily built tables
+    size_t allocs = allocations();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < runs; ++i)
+        f();
+    double ns = std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - start).count() / runs;
+    double allocsPerRun = static_cast<double>(allocations() - allocs) / runs;
+    if (bytes)
+        std::printf("  %-44s %12.1f ns %10.1f allocs %9.1f MB/s\n", name, ns, allocsPerRun, bytes * 1e3 / ns);
+    else
+        std::printf("  %-44s %12.1f ns %10.1f allocs\n", name, ns, allocsPerRun);
+}
+
+// Benchmark groups, each prints a title line and its measurements
+void benchValue();
+void benchMap();
+void benchJson();
+void benchChannel();
+
+#endif // BENCH_H
@@ -0,0 +1,24 @@
+CONFIG -= qt
+CONFIG += console c++17
+
+TEMPLATE = app
+TARGET = hybridge_bench
+
+# The library sources are built in, with the same CONFIG options
+# (no_zlib, json_scalar, json_sse42, json_avx2) to compare builds.
+DEFINES += HYBRIDGE_LIBRARY
+
+include(../core/core.pri)
+include(../priv/priv.pri)
+
+INCLUDEPATH += $$PWD/.. $$PWD/../../rapidjson/include
+
+SOURCES += \
+    $$PWD/benchchannel.cpp \
+    $$PWD/benchjson.cpp \
+    $$PWD/benchmap.cpp \
+    $$PWD/benchvalue.cpp \
+    $$PWD/main.cpp
+
+HEADERS += \
+    $$PWD/bench.h
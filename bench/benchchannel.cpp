@@ -0,0 +1,296 @@
+#include "bench.h"
+
+#include "core/channel.h"
+#include "core/compression.h"
+#include "core/transport.h"
+#include "core/updatescheduler.h"
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Objects of the benchmarks, three notified int properties and a method
+struct Item
+{
+    int values[3] = {0, 0, 0};
+};
+
+class ItemMethod : public EmptyMetaMethod
+{
+public:
+    ItemMethod(char const * name, size_t index, bool signal)
+        : name_(name), index_(index), signal_(signal) {}
+    char const * name() const override { return name_; }
+    bool isValid() const override { return true; }
+    bool isSignal() const override { return signal_; }
+    bool isPublic() const override { return true; }
+    size_t methodIndex() const override { return index_; }
+    Value::Type returnType() const override { return signal_ ? Value::None : Value::Int; }
+    size_t parameterCount() const override { return signal_ ? 0 : 2; }
+    Value::Type parameterType(size_t) const override { return Value::Int; }
+    char const * parameterName(size_t index) const override { return index ? "b" : "a"; }
+    bool invoke(Object *, Array && args, Response const & resp) const override
+    {
+        resp(args[0].toInt() + args[1].toInt());
+        return true;
+    }
+private:
+    char const * name_;
+    size_t index_;
+    bool signal_;
+};
+
+class ItemProperty : public MetaProperty
+{
+public:
+    ItemProperty(char const * name, size_t index, ItemMethod const & notify)
+        : name_(name), index_(index), notify_(notify) {}
+    char const * name() const override { return name_; }
+    bool isValid() const override { return true; }
+    Value::Type type() const override { return Value::Int; }
+    bool isConstant() const override { return false; }
+    size_t propertyIndex() const override { return index_; }
+    bool hasNotifySignal() const override { return true; }
+    size_t notifySignalIndex() const override { return notify_.methodIndex(); }
+    MetaMethod const & notifySignal() const override { return notify_; }
+    Value read(Object const * object) const override
+    {
+        return static_cast<Item const *>(object)->values[index_];
+    }
+    bool write(Object * object, Value && value) const override
+    {
+        static_cast<Item *>(object)->values[index_] = value.toInt();
+        return true;
+    }
+private:
+    char const * name_;
+    size_t index_;
+    ItemMethod const & notify_;
+};
+
+class ItemMetaObject : public MetaObject
+{
+public:
+    ItemMetaObject()
+        : methods_{{"destroyed", 0, true}, {"xChanged", 1, true}, {"yChanged", 2, true},
+                   {"zChanged", 3, true}, {"add", 4, false}}
+        , properties_{{"x", 0, methods_[1]}, {"y", 1, methods_[2]}, {"z", 2, methods_[3]}}
+    {
+    }
+    char const * className() const override { return "Item"; }
+    size_t propertyCount() const override { return 3; }
+    MetaProperty const & property(size_t index) const override { return properties_[index]; }
+    size_t methodCount() const override { return 5; }
+    MetaMethod const & method(size_t index) const override { return methods_[index]; }
+    size_t enumeratorCount() const override { return 0; }
+    MetaEnum const & enumerator(size_t) const override { std::abort(); }
+    bool connect(Connection const & c) const override
+    {
+        connections_.emplace(c.object(), c);
+        return true;
+    }
+    bool disconnect(Connection const & c) const override
+    {
+        auto range = connections_.equal_range(c.object());
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == c) {
+                connections_.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Emit the notify signal of @p property of @p item
+    void notify(Item * item, size_t property) const
+    {
+        auto range = connections_.equal_range(item);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second.signalIndex() == property + 1)
+                it->second.signal(Array());
+        }
+    }
+private:
+    ItemMethod methods_[5];
+    ItemProperty properties_[3];
+    mutable std::unordered_multimap<Object const *, Connection> connections_;
+};
+
+class BenchChannel : public Channel
+{
+public:
+    explicit BenchChannel(ItemMetaObject & meta) : meta_(meta) {}
+    void tick() { timerEvent(); }
+protected:
+    MetaObject * metaObject(Object const *) const override { return &meta_; }
+    std::string createUuid() const override { return std::to_string(++uuid_); }
+    ProxyObject * createProxyObject(Map &&) const override { return nullptr; }
+    void startTimer(int) override {}
+    void stopTimer() override {}
+private:
+    ItemMetaObject & meta_;
+    mutable int uuid_ = 0;
+};
+
+// Serializes what is sent as a socket transport would, keeps the last frame
+class BenchTransport : public Transport
+{
+public:
+    explicit BenchTransport(bool frames = false, bool compression = false)
+        : frames_(frames), compression_(compression) {}
+    void sendMessage(Message && message) override { last = serialize(message); }
+    bool supportsFrames() const override { return frames_; }
+    void sendFrame(Value && frame) override { bytes += frame.toBytes().size(); }
+    bool supportsCompression() const override { return compression_; }
+    void receive(std::string const & data) { messageReceived(std::string(data)); }
+    std::string last;
+    size_t bytes = 0;
+private:
+    bool frames_;
+    bool compression_;
+};
+
+std::string const initRequest = "{\"type\":3,\"id\":1}";
+// acknowledge property updates, with credits for as many as wanted
+std::string const idleRequest = "{\"type\":4,\"data\":2147483647}";
+
+// Objects registered on a channel, with their own meta object so that no
+//  connections outlive them
+struct Registry
+{
+    explicit Registry(int objects)
+        : items(static_cast<size_t>(objects))
+        , channel(meta)
+    {
+        channel.updateScheduler()->setInterval(0);
+        for (size_t i = 0; i < items.size(); ++i) {
+            items[i].values[0] = static_cast<int>(i);
+            channel.registerObject("item" + std::to_string(i), &items[i]);
+        }
+    }
+    std::vector<Item> items;
+    ItemMetaObject meta;
+    BenchChannel channel;
+};
+
+} // namespace
+
+void benchChannel()
+{
+    std::printf("channel\n");
+
+    // user-001: time and allocations of a TypeInvokeMethod round trip, see
+    //  the value group for scalars inline versus boxed
+    {
+        Registry registry(1);
+        BenchTransport client;
+        registry.channel.connectTo(&client);
+        client.receive(initRequest);
+        std::string const invoke = "{\"type\":6,\"id\":7,\"object\":\"item0\",\"method\":4,\"args\":[20,22]}";
+        measure("invoke method round trip", 100000, [&] {
+            client.receive(invoke);
+        });
+        registry.channel.disconnectFrom(&client);
+    }
+
+    // user-022: connect storms against a 10k object registry, served from
+    //  the init snapshot after the first client
+    {
+        Registry registry(10000);
+        for (size_t clients : {1, 100, 1000}) {
+            std::string name = "init storm of " + std::to_string(clients) + " clients, 10k objects";
+            measure(name.c_str(), 1, [&] {
+                std::vector<std::unique_ptr<BenchTransport>> transports;
+                for (size_t i = 0; i < clients; ++i) {
+                    transports.emplace_back(new BenchTransport);
+                    registry.channel.connectTo(transports.back().get());
+                    transports.back()->receive(initRequest);
+                }
+                for (auto & transport : transports)
+                    registry.channel.disconnectFrom(transport.get());
+            });
+        }
+    }
+
+    // user-020: compression of the init response of a 5k object registry,
+    //  and of a stream of property updates with one context
+    if (Compression::available()) {
+        Registry registry(5000);
+        BenchTransport client;
+        registry.channel.connectTo(&client);
+        client.receive(initRequest);
+        std::string const init = client.last;
+        registry.channel.disconnectFrom(&client);
+        size_t compressed = 0;
+        measure("deflate init response, 5k objects", 10, [&init, &compressed] {
+            Compression compression;
+            std::string data = init;
+            compression.compress(data);
+            compressed = data.size();
+        }, init.size());
+        std::printf("  init response %zu bytes, deflated %zu bytes (%.1f%%)\n",
+                    init.size(), compressed, compressed * 100.0 / init.size());
+        std::string data = init;
+        Compression().compress(data);
+        measure("inflate init response, 5k objects", 10, [&data] {
+            Compression compression;
+            std::string copy = data;
+            compression.decompress(copy);
+        }, init.size());
+
+        BenchTransport updates(false, true);
+        registry.channel.connectTo(&updates);
+        updates.setCompressionThreshold(0);
+        updates.receive("{\"type\":3,\"id\":1,\"compression\":\"deflate\"}");
+        updates.receive(idleRequest);
+        // the client side context, inflating the frames in order
+        Compression stream;
+        stream.decompress(updates.last);
+        size_t plain = 0;
+        size_t sent = 0;
+        for (int round = 0; round < 100; ++round) {
+            for (size_t i = 0; i < 100; ++i) {
+                Item & item = registry.items[i * 50];
+                item.values[1] = round;
+                registry.meta.notify(&item, 1);
+            }
+            registry.channel.tick();
+            sent += updates.last.size();
+            std::string copy = updates.last;
+            stream.decompress(copy);
+            plain += copy.size();
+        }
+        std::printf("  100 update batches: %zu bytes, deflated %zu bytes (%.1f%%) with one context\n",
+                    plain, sent, sent * 100.0 / plain);
+        registry.channel.disconnectFrom(&updates);
+    }
+
+    // user-025: fan-out of a property update to subscribers, encoded once
+    //  as a shared frame versus once per transport
+    for (bool frames : {false, true}) {
+        for (size_t subscribers : {1, 10, 100, 300}) {
+            Registry registry(1);
+            std::vector<std::unique_ptr<BenchTransport>> transports;
+            for (size_t i = 0; i < subscribers; ++i) {
+                transports.emplace_back(new BenchTransport(frames));
+                registry.channel.connectTo(transports.back().get());
+                transports.back()->receive(initRequest);
+                transports.back()->receive(idleRequest);
+            }
+            Item & item = registry.items[0];
+            std::string name = "update to " + std::to_string(subscribers)
+                    + (frames ? " subscribers, shared frame" : " subscribers, per transport");
+            measure(name.c_str(), 1000, [&] {
+                ++item.values[2];
+                registry.meta.notify(&item, 2);
+                registry.channel.tick();
+            });
+            for (auto & transport : transports)
+                registry.channel.disconnectFrom(transport.get());
+        }
+    }
+}
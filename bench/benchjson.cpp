@@ -0,0 +1,185 @@
+#include "bench.h"
+
+#include "core/arena.h"
+#include "core/message.h"
+
+#include <string>
+
+static std::string toJson(Value const & value)
+{
+    std::string json;
+    Value::writeJson(value, json);
+    return json;
+}
+
+// Property updates of @p objects objects with three changed properties each
+static Value updateBatch(int objects)
+{
+    Array data;
+    for (int i = 0; i < objects; ++i) {
+        IntMap signals;
+        signals[1] = Array();
+        IntMap properties;
+        properties[0] = i;
+        properties[1] = i * 0.5;
+        properties[2] = "label " + std::to_string(i);
+        Map entry;
+        entry[KEY_OBJECT] = "object" + std::to_string(i);
+        entry[KEY_SIGNALS] = std::move(signals);
+        entry[KEY_PROPERTIES] = std::move(properties);
+        data.emplace_back(std::move(entry));
+    }
+    Message message;
+    message[KEY_TYPE] = static_cast<int>(TypePropertyUpdate);
+    message[KEY_DATA] = std::move(data);
+    return message;
+}
+
+// Response to an init of @p objects objects of one class
+static Value initResponse(int objects)
+{
+    Map data;
+    for (int i = 0; i < objects; ++i) {
+        Array destroyed;
+        destroyed.emplace_back("destroyed");
+        destroyed.emplace_back(0);
+        Array signals;
+        signals.emplace_back(std::move(destroyed));
+        Array methods;
+        for (int m = 0; m < 4; ++m) {
+            Array method;
+            method.emplace_back("method" + std::to_string(m));
+            method.emplace_back(m + 3);
+            methods.emplace_back(std::move(method));
+        }
+        Array properties;
+        for (int p = 0; p < 3; ++p) {
+            Array property;
+            property.emplace_back(p);
+            property.emplace_back("property" + std::to_string(p));
+            Array notify;
+            notify.emplace_back(1);
+            notify.emplace_back(p + 1);
+            property.emplace_back(std::move(notify));
+            property.emplace_back(i * 10 + p);
+            properties.emplace_back(std::move(property));
+        }
+        Map info;
+        info[KEY_CLASS] = "Object";
+        info[KEY_SIGNALS] = std::move(signals);
+        info[KEY_METHODS] = std::move(methods);
+        info[KEY_PROPERTIES] = std::move(properties);
+        data[Key("object" + std::to_string(i))] = std::move(info);
+    }
+    Message message;
+    message[KEY_TYPE] = static_cast<int>(TypeResponse);
+    message[KEY_ID] = 1;
+    message[KEY_DATA] = std::move(data);
+    return message;
+}
+
+void benchJson()
+{
+    std::printf("json\n");
+
+    std::string invoke = "{\"type\":6,\"id\":12,\"object\":\"object7\",\"method\":5,\"args\":[1,2.5,\"text\"]}";
+    // the same in the compact envelope
+    std::string compactInvoke = "[6,12,\"object7\",5,[1,2.5,\"text\"]]";
+    std::string batch = toJson(updateBatch(100));
+    std::string init = toJson(initResponse(1000));
+
+    // user-002, user-012: messages parsed per second, the tree in an arena
+    //  and parsed with the SIMD path the build targets
+    measure("parse invoke message", 100000, [&invoke] {
+        keep(Value::fromJson(std::string(invoke)));
+    }, invoke.size());
+    measure("parse update batch of 100 objects", 1000, [&batch] {
+        keep(Value::fromJson(std::string(batch)));
+    }, batch.size());
+    measure("parse init response of 1000 objects", 100, [&init] {
+        keep(Value::fromJson(std::string(init)));
+    }, init.size());
+    // user-013: lazy parsing leaves the arguments raw, in both envelopes
+    measure("lazy parse of an invoke message", 100000, [&invoke] {
+        keep(Value::fromJsonLazy(std::string(invoke)));
+    }, invoke.size());
+    measure("parse compact invoke message", 100000, [&compactInvoke] {
+        keep(Value::fromJson(std::string(compactInvoke)));
+    }, compactInvoke.size());
+    measure("lazy parse of a compact invoke message", 100000, [&compactInvoke] {
+        keep(Value::fromJsonLazy(std::string(compactInvoke)));
+    }, compactInvoke.size());
+
+    // user-002: the same tree allocated in an arena and on the heap
+    Value tree = Value::fromJson(std::string(batch));
+    measure("build update batch on the heap", 1000, [&tree] {
+        keep(tree.persist());
+    });
+    measure("build update batch in an arena", 1000, [&tree] {
+        Arena::Scope scope;
+        keep(tree.clone());
+    });
+
+    // user-010: serialized bytes per second, into a reused buffer
+    Value updates = updateBatch(100);
+    std::string out;
+    measure("writeJson update batch, reused buffer", 1000, [&updates, &out] {
+        out.clear();
+        Value::writeJson(updates, out);
+    }, batch.size());
+    measure("toJson update batch, new string", 1000, [&updates] {
+        keep(Value::toJson(updates));
+    }, batch.size());
+
+    // user-009: 1M element numeric arrays, packed versus boxed
+    constexpr int count = 1000000;
+    std::string numbers = "[0";
+    for (int i = 1; i < count; ++i)
+        numbers += "," + std::to_string(i);
+    numbers += "]";
+    measure("parse 1M ints (packed)", 10, [&numbers] {
+        keep(Value::fromJson(std::string(numbers)));
+    }, numbers.size());
+    IntArray packed;
+    Array boxed;
+    for (int i = 0; i < count; ++i) {
+        packed.push_back(i);
+        boxed.emplace_back(i);
+    }
+    std::printf("  1M ints: %zu bytes packed, %zu bytes boxed\n",
+                packed.size() * sizeof(int), boxed.size() * sizeof(Value));
+    measure("build 1M ints packed", 10, [] {
+        IntArray array;
+        for (int i = 0; i < count; ++i)
+            array.push_back(i);
+        keep(array);
+    });
+    measure("build 1M ints boxed", 10, [] {
+        Array array;
+        for (int i = 0; i < count; ++i)
+            array.emplace_back(i);
+        keep(array);
+    });
+    Value packedValue(std::move(packed));
+    Value boxedValue(std::move(boxed));
+    measure("writeJson 1M ints packed", 10, [&packedValue, &out] {
+        out.clear();
+        Value::writeJson(packedValue, out);
+    }, numbers.size());
+    measure("writeJson 1M ints boxed", 10, [&boxedValue, &out] {
+        out.clear();
+        Value::writeJson(boxedValue, out);
+    }, numbers.size());
+    DoubleArray doubles;
+    for (int i = 0; i < count; ++i)
+        doubles.push_back(i * 0.001);
+    Value doublesValue(std::move(doubles));
+    std::string doublesJson = toJson(doublesValue);
+    measure("writeJson 1M doubles packed", 10, [&doublesValue, &out] {
+        out.clear();
+        Value::writeJson(doublesValue, out);
+    }, doublesJson.size());
+    measure("parse 1M doubles (packed)", 10, [&doublesJson] {
+        keep(Value::fromJson(std::string(doublesJson)));
+    }, doublesJson.size());
+}
@@ -0,0 +1,69 @@
+#include "bench.h"
+
+#include "core/message.h"
+
+#include <map>
+#include <string>
+
+void benchMap()
+{
+    std::printf("map\n");
+
+    // user-003: message dispatch, lookups of the well-known keys
+    Key const * keys[] = {&KEY_TYPE, &KEY_ID, &KEY_OBJECT, &KEY_METHOD, &KEY_ARGS};
+    std::map<std::string, Value> tree;
+    Message flat;
+    for (Key const * key : keys) {
+        tree[key->str()] = Value(1);
+        flat[*key] = Value(1);
+    }
+    measure("std::map build of an invoke message", 100000, [&keys] {
+        std::map<std::string, Value> message;
+        for (Key const * key : keys)
+            message[key->str()] = Value(1);
+        keep(message);
+    });
+    measure("Message build of an invoke message", 100000, [&keys] {
+        Message message;
+        for (Key const * key : keys)
+            message[*key] = Value(1);
+        keep(message);
+    });
+    measure("std::map dispatch lookups (x5)", 1000000, [&keys, &tree] {
+        int sum = 0;
+        for (Key const * key : keys)
+            sum += tree.find(key->str())->second.toInt();
+        keep(sum);
+    });
+    measure("Message dispatch lookups (x5)", 1000000, [&keys, &flat] {
+        int sum = 0;
+        for (Key const * key : keys)
+            sum += flat.find(*key)->second.toInt();
+        keep(sum);
+    });
+    Value message = Value::fromJson(std::string(
+            "{\"type\":6,\"id\":1,\"object\":\"a\",\"method\":3,\"args\":[]}"));
+    Message const & parsed = message.toMap();
+    measure("parsed Message dispatch lookups (x5)", 1000000, [&keys, &parsed] {
+        size_t n = 0;
+        for (Key const * key : keys)
+            n += parsed.count(*key);
+        keep(n);
+    });
+
+    // larger maps are indexed
+    Message wide;
+    std::map<std::string, Value> wideTree;
+    for (int i = 0; i < 64; ++i) {
+        std::string name = "property" + std::to_string(i);
+        wide[Key::intern(name)] = Value(i);
+        wideTree[name] = Value(i);
+    }
+    Key probe = Key::intern("property42");
+    measure("std::map lookup in 64 members", 1000000, [&wideTree, &probe] {
+        keep(wideTree.find(probe.str())->second.toInt());
+    });
+    measure("Message lookup in 64 members", 1000000, [&wide, &probe] {
+        keep(wide.find(probe)->second.toInt());
+    });
+}
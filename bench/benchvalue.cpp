@@ -0,0 +1,120 @@
+#include "bench.h"
+
+#include "core/value.h"
+
+#include <cmath>
+#include <string>
+
+// Allocate and free a heap node for @p t, as Value did for every scalar
+template<typename T>
+static void boxed(T t)
+{
+    T * volatile p = new T(t);
+    delete p;
+}
+
+// A tree of @p depth levels, maps of @p width members alternating with arrays
+static Value buildTree(int depth, int width)
+{
+    if (depth == 0)
+        return Value(depth + width + 0.5);
+    if (depth % 2) {
+        Map map;
+        for (int i = 0; i < width; ++i)
+            map[Key::intern("m" + std::to_string(i))] = buildTree(depth - 1, width);
+        return map;
+    }
+    Array array;
+    array.reserve(static_cast<size_t>(width));
+    array.emplace_back(depth);
+    array.emplace_back("leaf");
+    for (int i = 2; i < width; ++i)
+        array.emplace_back(buildTree(depth - 1, width));
+    return array;
+}
+
+void benchValue()
+{
+    std::printf("value\n");
+
+    // user-001: scalars are stored inline, no allocation per value
+    measure("scalars construct/destroy (x5)", 1000000, [] {
+        Value b(true), n(42), l(42LL), f(1.5f), d(2.5);
+        keep(b); keep(n); keep(l); keep(f); keep(d);
+    });
+    // the previous layout, a heap node per scalar
+    measure("boxed scalars construct/destroy (x5)", 1000000, [] {
+        boxed(true); boxed(42); boxed(42LL); boxed(1.5f); boxed(2.5);
+    });
+    measure("array of 16 scalar arguments", 100000, [] {
+        Array args;
+        args.reserve(16);
+        for (int i = 0; i < 16; ++i)
+            args.emplace_back(i);
+        keep(args);
+    });
+
+    // user-006: mixed type conversions, straight into the result
+    Array mixed;
+    for (int i = 0; i < 64; ++i) {
+        switch (i % 4) {
+        case 0: mixed.emplace_back(static_cast<long long>(i)); break;
+        case 1: mixed.emplace_back(i + 0.25); break;
+        case 2: mixed.emplace_back(std::to_string(i)); break;
+        default: mixed.emplace_back(i % 8 == 3); break;
+        }
+    }
+    measure("toInt() of 64 mixed values", 100000, [&mixed] {
+        int sum = 0;
+        for (Value const & v : mixed)
+            sum += v.toInt();
+        keep(sum);
+    });
+    measure("convert(Double) of 64 mixed values", 100000, [&mixed] {
+        for (Value const & v : mixed)
+            keep(v.convert(Value::Double));
+    });
+    measure("convert(String) of 64 mixed values", 100000, [&mixed] {
+        for (Value const & v : mixed)
+            keep(v.convert(Value::String));
+    });
+    // client input that is no integer, or none in range, converts to 0
+    Array malformed;
+    for (char const * s : {"12abc", "1e30", "99999999999999999999", "nan", "inf", "1.5", " 5", "-0"})
+        malformed.emplace_back(s);
+    malformed.emplace_back(1e30);
+    malformed.emplace_back(std::nan(""));
+    measure("toLong() of 10 malformed values", 100000, [&malformed] {
+        long long sum = 0;
+        for (Value const & v : malformed)
+            sum += v.toLong();
+        keep(sum);
+    });
+    measure("convert(Int) of 10 malformed values", 100000, [&malformed] {
+        for (Value const & v : malformed)
+            keep(v.convert(Value::Int));
+    });
+
+    // user-015: destruction and serialization dispatched over the type tag
+    for (int depth : {4, 8}) {
+        int width = depth == 4 ? 8 : 3;
+        std::string name = "deep tree " + std::to_string(depth) + "x" + std::to_string(width);
+        measure((name + " construct/destroy").c_str(), depth == 4 ? 2000 : 1000, [=] {
+            keep(buildTree(depth, width));
+        });
+        Value tree = buildTree(depth, width);
+        std::string out;
+        Value::writeJson(tree, out);
+        size_t bytes = out.size();
+        measure((name + " clone").c_str(), 1000, [&tree] {
+            keep(tree.clone());
+        });
+        measure((name + " writeJson").c_str(), 1000, [&tree, &out] {
+            out.clear();
+            Value::writeJson(tree, out);
+        }, bytes);
+        measure((name + " hash").c_str(), 1000, [&tree] {
+            keep(tree.hash());
+        });
+    }
+}
@@ -0,0 +1,60 @@
+#include "bench.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+static std::atomic<size_t> allocations_{0};
+
+void * operator new(size_t size)
+{
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+    if (void * p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+    std::free(p);
+}
+
+size_t allocations()
+{
+    return allocations_.load(std::memory_order_relaxed);
+}
+
+void const * volatile benchSink = nullptr;
+
+static struct
+{
+    char const * name;
+    void (*run)();
+} const groups[] = {
+    {"value", benchValue},
+    {"map", benchMap},
+    {"json", benchJson},
+    {"channel", benchChannel},
+};
+
+// Usage: hybridge_bench [group...], all groups without arguments
+int main(int argc, char * argv[])
+{
+    // the publisher traces property values on std::cout
+    std::cout.setstate(std::ios::failbit);
+    for (auto & group : groups) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i)
+            selected = selected || std::strcmp(argv[i], group.name) == 0;
+        if (selected)
+            group.run();
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "arena.h"
+
+#include <new>
+
+namespace {
+
+    struct alignas(std::max_align_t) Header
+    {
+        Arena * owner;
+    };
+
+    constexpr size_t ALIGN = alignof(std::max_align_t);
+
+    // first block fits most messages, later blocks grow up to the max size
+    constexpr size_t FIRST_BLOCK_SIZE = 2048;
+    constexpr size_t MAX_BLOCK_SIZE = 65536;
+
+    thread_local Arena * current = nullptr;
+}
+
+struct alignas(std::max_align_t) Arena::Block
+{
+    Block * next;
+};
+
+struct alignas(std::max_align_t) Arena::Kept
+{
+    Kept * next;
+    void (*destroy)(void *);
+};
+
+Arena::Scope::Scope()
+    : arena_(new Arena)
+    , saved_(current)
+{
+    current = arena_;
+}
+
+Arena::Scope::Scope(const void *allocation)
+    : arena_(static_cast<Header const *>(allocation)[-1].owner)
+    , saved_(current)
+{
+    if (arena_)
+        ++arena_->live_;
+    current = arena_;
+}
+
+Arena::Scope::~Scope()
+{
+    current = saved_;
+    // drop the reference held by the scope
+    if (arena_)
+        arena_->release();
+}
+
+Arena::Heap::Heap()
+    : saved_(current)
+{
+    current = nullptr;
+}
+
+Arena::Heap::~Heap()
+{
+    current = saved_;
+}
+
+void * Arena::allocate(size_t size)
+{
+    Arena * arena = current;
+    Header * h;
+    if (arena) {
+        h = static_cast<Header *>(arena->alloc(sizeof(Header) + size));
+        ++arena->live_;
+    } else {
+        h = static_cast<Header *>(::operator new(sizeof(Header) + size));
+    }
+    h->owner = arena;
+    return h + 1;
+}
+
+void Arena::deallocate(void *p)
+{
+    if (p == nullptr)
+        return;
+    Header * h = static_cast<Header *>(p) - 1;
+    if (h->owner)
+        h->owner->release();
+    else
+        ::operator delete(h);
+}
+
+Arena::Arena()
+    : next_(FIRST_BLOCK_SIZE)
+    , live_(1)
+{
+}
+
+Arena::~Arena()
+{
+    while (kept_) {
+        kept_->destroy(kept_ + 1);
+        kept_ = kept_->next;
+    }
+    while (blocks_) {
+        Block * b = blocks_;
+        blocks_ = b->next;
+        ::operator delete(b);
+    }
+}
+
+void * Arena::alloc(size_t size)
+{
+    size = (size + ALIGN - 1) & ~(ALIGN - 1);
+    if (static_cast<size_t>(end_ - cur_) < size) {
+        size_t bsize = next_ < size ? size : next_;
+        if (next_ < MAX_BLOCK_SIZE)
+            next_ *= 2;
+        Block * b = static_cast<Block *>(::operator new(sizeof(Block) + bsize));
+        b->next = blocks_;
+        blocks_ = b;
+        cur_ = reinterpret_cast<char *>(b + 1);
+        end_ = cur_ + bsize;
+    }
+    void * p = cur_;
+    cur_ += size;
+    return p;
+}
+
+void * Arena::keep(size_t size, void (*destroy)(void *))
+{
+    Arena * arena = current;
+    if (arena == nullptr)
+        return nullptr;
+    Kept * k = static_cast<Kept *>(arena->alloc(sizeof(Kept) + size));
+    k->next = arena->kept_;
+    k->destroy = destroy;
+    arena->kept_ = k;
+    return k + 1;
+}
+
+void Arena::release()
+{
+    if (--live_ == 0)
+        delete this;
+}
@@ -0,0 +1,144 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "Hybridge_global.h"
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+/*
+ * Monotonic allocation arena for short lived value trees.
+ *
+ * While an Arena::Scope is alive on a thread, all value nodes, array buffers
+ *  and map nodes allocated on that thread come from the arena blocks. Freeing
+ *  an arena allocation only decrements a live counter, the blocks are released
+ *  together once the scope has ended and the last allocation is gone.
+ *
+ * Every allocation carries a small header pointing to its owner arena (or
+ *  null for plain heap allocations), so arena and heap allocated nodes may be
+ *  mixed freely in the same containers.
+ *
+ * Any surviving node keeps its whole arena alive, with the buffers kept by
+ *  it. Values kept long after their message are copied out to the heap, see
+ *  Value::persist().
+ */
+class HYBRIDGE_EXPORT Arena
+{
+public:
+    class HYBRIDGE_EXPORT Scope
+    {
+    public:
+        Scope();
+
+        /*
+         * Enter the arena owning @p allocation again, to add to its tree.
+         *  Heap allocations are entered as no scope at all.
+         */
+        explicit Scope(void const * allocation);
+
+        ~Scope();
+
+        Scope(Scope const & o) = delete;
+
+        Scope & operator=(Scope const & o) = delete;
+
+    private:
+        Arena * arena_;
+        Arena * saved_;
+    };
+
+    /*
+     * Suspend the scope active on the thread, allocations go to the heap
+     *  while a Heap is alive.
+     */
+    class HYBRIDGE_EXPORT Heap
+    {
+    public:
+        Heap();
+
+        ~Heap();
+
+        Heap(Heap const & o) = delete;
+
+        Heap & operator=(Heap const & o) = delete;
+
+    private:
+        Arena * saved_;
+    };
+
+public:
+    static void * allocate(size_t size);
+
+    static void deallocate(void * p);
+
+    template<typename T, typename ...Args>
+    static T * create(Args && ...args)
+    {
+        return new (allocate(sizeof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template<typename T>
+    static void destroy(T * t)
+    {
+        t->~T();
+        deallocate(t);
+    }
+
+    /*
+     * Move @p t into the arena of the current scope, it is destroyed together
+     *  with the arena blocks. Returns nullptr when no scope is active.
+     */
+    template<typename T>
+    static T * keep(T && t)
+    {
+        void * p = keep(sizeof(T), [](void * v) { static_cast<T *>(v)->~T(); });
+        return p ? new (p) T(std::move(t)) : nullptr;
+    }
+
+private:
+    Arena();
+
+    ~Arena();
+
+    void * alloc(size_t size);
+
+    void release();
+
+    static void * keep(size_t size, void (*destroy)(void *));
+
+private:
+    struct Block;
+    struct Kept;
+
+    Block * blocks_ = nullptr;
+    Kept * kept_ = nullptr;
+    char * cur_ = nullptr;
+    char * end_ = nullptr;
+    size_t next_;
+    // allocations alive, plus one while the scope is alive
+    std::atomic<size_t> live_;
+};
+
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    ArenaAllocator() = default;
+
+    template<typename U>
+    ArenaAllocator(ArenaAllocator<U> const &) {}
+
+    T * allocate(size_t n) { return static_cast<T*>(Arena::allocate(n * sizeof(T))); }
+
+    void deallocate(T * p, size_t) { Arena::deallocate(p); }
+
+    friend bool operator==(ArenaAllocator const &, ArenaAllocator const &) { return true; }
+
+    friend bool operator!=(ArenaAllocator const &, ArenaAllocator const &) { return false; }
+};
+
+#endif // ARENA_H
@@ -0,0 +1,406 @@
+#include "value.h"
+
+#include <string.h>
+#include <stdint.h>
+
+/*
+ * Binary encoding of values, MessagePack compatible for all plain types.
+ *
+ * Floats keep their precision (float 32), Bytes are bin, packed arrays are
+ *  ext types holding their elements little endian, so they are copied as is
+ *  on common hosts. IntMap keys are integers. Object pointers are not
+ *  transferable and encoded as nil.
+ */
+
+namespace {
+
+    enum Ext : unsigned char
+    {
+        ExtIntArray = 1,
+        ExtLongArray = 2,
+        ExtFloatArray = 3,
+        ExtDoubleArray = 4,
+    };
+
+    bool const littleEndian = [] {
+        uint16_t n = 1;
+        unsigned char c;
+        memcpy(&c, &n, 1);
+        return c == 1;
+    }();
+
+    template<typename T>
+    void putBig(std::string & out, T t)
+    {
+        char b[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); ++i)
+            b[i] = static_cast<char>(t >> ((sizeof(T) - 1 - i) * 8));
+        out.append(b, sizeof(T));
+    }
+
+    void putHeader(std::string & out, size_t n, unsigned char fix, size_t fixMax, unsigned char c8, unsigned char c16)
+    {
+        if (fix && n <= fixMax) {
+            out.push_back(static_cast<char>(fix | n));
+        } else if (c8 && n <= 0xff) {
+            out.push_back(static_cast<char>(c8));
+            out.push_back(static_cast<char>(n));
+        } else if (n <= 0xffff) {
+            out.push_back(static_cast<char>(c16));
+            putBig(out, static_cast<uint16_t>(n));
+        } else {
+            // 32 bit variant follows the 16 bit one in all families
+            out.push_back(static_cast<char>(c16 + 1));
+            putBig(out, static_cast<uint32_t>(n));
+        }
+    }
+
+    void putInt(std::string & out, long long n)
+    {
+        if (n >= -32 && n <= 127) {
+            out.push_back(static_cast<char>(n));
+        } else if (n >= INT8_MIN && n <= INT8_MAX) {
+            out.push_back(static_cast<char>(0xd0));
+            out.push_back(static_cast<char>(n));
+        } else if (n >= INT16_MIN && n <= INT16_MAX) {
+            out.push_back(static_cast<char>(0xd1));
+            putBig(out, static_cast<uint16_t>(n));
+        } else if (n >= INT32_MIN && n <= INT32_MAX) {
+            out.push_back(static_cast<char>(0xd2));
+            putBig(out, static_cast<uint32_t>(n));
+        } else {
+            out.push_back(static_cast<char>(0xd3));
+            putBig(out, static_cast<uint64_t>(n));
+        }
+    }
+
+    template<typename P>
+    void putPacked(std::string & out, P const & p, Ext ext)
+    {
+        typedef typename P::value_type E;
+        size_t n = p.size() * sizeof(E);
+        if (n <= 0xff) {
+            out.push_back(static_cast<char>(0xc7));
+            out.push_back(static_cast<char>(n));
+        } else if (n <= 0xffff) {
+            out.push_back(static_cast<char>(0xc8));
+            putBig(out, static_cast<uint16_t>(n));
+        } else {
+            out.push_back(static_cast<char>(0xc9));
+            putBig(out, static_cast<uint32_t>(n));
+        }
+        out.push_back(static_cast<char>(ext));
+        if (littleEndian) {
+            out.append(reinterpret_cast<char const *>(p.data()), n);
+            return;
+        }
+        for (E e : p) {
+            char b[sizeof(E)];
+            memcpy(b, &e, sizeof(E));
+            for (size_t i = sizeof(E); i > 0; --i)
+                out.push_back(b[i - 1]);
+        }
+    }
+
+    struct BinaryVisitor
+    {
+        std::string & out;
+
+        void operator()(std::nullptr_t) { out.push_back(static_cast<char>(0xc0)); }
+        void operator()(bool b) { out.push_back(static_cast<char>(b ? 0xc3 : 0xc2)); }
+        void operator()(int n) { putInt(out, n); }
+        void operator()(long long n) { putInt(out, n); }
+        void operator()(Object *) { (*this)(nullptr); }
+
+        void operator()(float f) {
+            uint32_t u;
+            memcpy(&u, &f, sizeof(u));
+            out.push_back(static_cast<char>(0xca));
+            putBig(out, u);
+        }
+
+        void operator()(double d) {
+            uint64_t u;
+            memcpy(&u, &d, sizeof(u));
+            out.push_back(static_cast<char>(0xcb));
+            putBig(out, u);
+        }
+
+        void operator()(std::string_view s) {
+            putHeader(out, s.size(), 0xa0, 31, 0xd9, 0xda);
+            out.append(s.data(), s.size());
+        }
+
+        void operator()(Bytes const & b) {
+            putHeader(out, b.size(), 0, 0, 0xc4, 0xc5);
+            out.append(reinterpret_cast<char const *>(b.data()), b.size());
+        }
+
+        void operator()(Array const & a) {
+            putHeader(out, a.size(), 0x90, 15, 0, 0xdc);
+            for (Value const & v : a)
+                v.visit(*this);
+        }
+
+        void operator()(Map const & m) {
+            putHeader(out, m.size(), 0x80, 15, 0, 0xde);
+            for (auto const & e : m) {
+                (*this)(std::string_view(e.first.str()));
+                e.second.visit(*this);
+            }
+        }
+
+        void operator()(IntMap const & m) {
+            putHeader(out, m.size(), 0x80, 15, 0, 0xde);
+            for (auto const & e : m) {
+                putInt(out, e.first);
+                e.second.visit(*this);
+            }
+        }
+
+        void operator()(IntArray const & a) { putPacked(out, a, ExtIntArray); }
+        void operator()(LongArray const & a) { putPacked(out, a, ExtLongArray); }
+        void operator()(FloatArray const & a) { putPacked(out, a, ExtFloatArray); }
+        void operator()(DoubleArray const & a) { putPacked(out, a, ExtDoubleArray); }
+    };
+}
+
+// Decodes in-situ, strings are views of the buffer
+struct BinaryReader
+{
+    char const * p;
+    char const * end;
+    size_t depth = 0;
+
+    static constexpr size_t MAX_DEPTH = 256;
+
+    bool has(size_t n) const { return static_cast<size_t>(end - p) >= n; }
+
+    template<typename T>
+    bool getBig(T & t)
+    {
+        if (!has(sizeof(T)))
+            return false;
+        t = 0;
+        for (size_t i = 0; i < sizeof(T); ++i)
+            t = static_cast<T>((t << 8) | static_cast<unsigned char>(*p++));
+        return true;
+    }
+
+    // @p c16 is the code of the 16 bit variant, preceded by the 8 bit one
+    //   and followed by the 32 bit one
+    bool length(unsigned char c, unsigned char c16, size_t & n)
+    {
+        if (c + 1 == c16) {
+            uint8_t l;
+            if (!getBig(l))
+                return false;
+            n = l;
+        } else if (c == c16) {
+            uint16_t l;
+            if (!getBig(l))
+                return false;
+            n = l;
+        } else {
+            uint32_t l;
+            if (!getBig(l))
+                return false;
+            n = l;
+        }
+        return true;
+    }
+
+    bool string(size_t n, Value & v)
+    {
+        if (!has(n))
+            return false;
+        v = Value::view(p, n);
+        p += n;
+        return true;
+    }
+
+    bool integer(long long n, Value & v)
+    {
+        // like the JSON parser, Long only if out of int range
+        if (n >= INT32_MIN && n <= INT32_MAX)
+            v = static_cast<int>(n);
+        else
+            v = n;
+        return true;
+    }
+
+    template<typename P>
+    bool packed(size_t n, Value & v)
+    {
+        typedef typename P::value_type E;
+        if (!has(n) || n % sizeof(E))
+            return false;
+        P a(n / sizeof(E));
+        if (littleEndian) {
+            memcpy(a.data(), p, n);
+        } else {
+            for (size_t i = 0; i < a.size(); ++i) {
+                char b[sizeof(E)];
+                for (size_t j = 0; j < sizeof(E); ++j)
+                    b[j] = p[i * sizeof(E) + sizeof(E) - 1 - j];
+                memcpy(&a[i], b, sizeof(E));
+            }
+        }
+        p += n;
+        v = std::move(a);
+        return true;
+    }
+
+    bool array(size_t n, Value & v)
+    {
+        // each element takes at least one byte
+        if (!has(n) || ++depth > MAX_DEPTH)
+            return false;
+        Array a;
+        a.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            a.emplace_back();
+            if (!read(a.back()))
+                return false;
+        }
+        --depth;
+        v = std::move(a);
+        return true;
+    }
+
+    // Maps with integer keys are IntMap, all keys of a map have the same type
+    bool map(size_t n, Value & v)
+    {
+        if (!has(n * 2) || ++depth > MAX_DEPTH)
+            return false;
+        Map m;
+        IntMap im;
+        for (size_t i = 0; i < n; ++i) {
+            Value k;
+            Value e;
+            if (!read(k) || !read(e))
+                return false;
+            if (k.isInt() && m.empty()) {
+                if (i == 0)
+                    im.reserve(n);
+                im.emplace(k.toInt(), std::move(e));
+            } else if (k.isString() && im.empty()) {
+                if (i == 0)
+                    m.reserve(n);
+                std::string_view s = k.toStringView();
+                m.emplace(Key(s.data(), s.size()), std::move(e));
+            } else {
+                return false;
+            }
+        }
+        --depth;
+        if (im.empty())
+            v = std::move(m);
+        else
+            v = std::move(im);
+        return true;
+    }
+
+    bool read(Value & v)
+    {
+        if (!has(1))
+            return false;
+        unsigned char c = static_cast<unsigned char>(*p++);
+        if (c <= 0x7f)
+            return integer(c, v);
+        if (c >= 0xe0)
+            return integer(static_cast<signed char>(c), v);
+        if ((c & 0xf0) == 0x80)
+            return map(c & 0x0f, v);
+        if ((c & 0xf0) == 0x90)
+            return array(c & 0x0f, v);
+        if ((c & 0xe0) == 0xa0)
+            return string(c & 0x1f, v);
+        size_t n = 0;
+        switch (c) {
+        case 0xc0: v = Value(); return true;
+        case 0xc2: v = false; return true;
+        case 0xc3: v = true; return true;
+        case 0xc4: case 0xc5: case 0xc6: {
+            if (!length(c, 0xc5, n) || !has(n))
+                return false;
+            v = Bytes(p, n);
+            p += n;
+            return true;
+        }
+        case 0xc7: case 0xc8: case 0xc9: {
+            if (!length(c, 0xc8, n) || !has(1))
+                return false;
+            unsigned char ext = static_cast<unsigned char>(*p++);
+            switch (ext) {
+            case ExtIntArray: return packed<IntArray>(n, v);
+            case ExtLongArray: return packed<LongArray>(n, v);
+            case ExtFloatArray: return packed<FloatArray>(n, v);
+            case ExtDoubleArray: return packed<DoubleArray>(n, v);
+            default: return false;
+            }
+        }
+        case 0xca: {
+            uint32_t u;
+            float f;
+            if (!getBig(u))
+                return false;
+            memcpy(&f, &u, sizeof(f));
+            v = f;
+            return true;
+        }
+        case 0xcb: {
+            uint64_t u;
+            double d;
+            if (!getBig(u))
+                return false;
+            memcpy(&d, &u, sizeof(d));
+            v = d;
+            return true;
+        }
+        case 0xcc: { uint8_t u; return getBig(u) && integer(u, v); }
+        case 0xcd: { uint16_t u; return getBig(u) && integer(u, v); }
+        case 0xce: { uint32_t u; return getBig(u) && integer(u, v); }
+        case 0xcf: { uint64_t u; return getBig(u) && integer(static_cast<long long>(u), v); }
+        case 0xd0: { uint8_t u; return getBig(u) && integer(static_cast<int8_t>(u), v); }
+        case 0xd1: { uint16_t u; return getBig(u) && integer(static_cast<int16_t>(u), v); }
+        case 0xd2: { uint32_t u; return getBig(u) && integer(static_cast<int32_t>(u), v); }
+        case 0xd3: { uint64_t u; return getBig(u) && integer(static_cast<long long>(u), v); }
+        case 0xd9: case 0xda: case 0xdb:
+            return length(c, 0xda, n) && string(n, v);
+        case 0xdc: case 0xdd:
+            return length(c, 0xdc, n) && array(n, v);
+        case 0xde: case 0xdf:
+            return length(c, 0xde, n) && map(n, v);
+        default:
+            return false;
+        }
+    }
+};
+
+void Value::writeBinary(const Value &value, std::string &out)
+{
+    value.visit(BinaryVisitor{out});
+}
+
+Value Value::fromBinary(std::string &&data)
+{
+    Arena::Scope scope;
+    // the arena owns the buffer, strings are views into it
+    std::string const * buffer = Arena::keep(std::move(data));
+    BinaryReader reader{buffer->data(), buffer->data() + buffer->size()};
+    Value v;
+    if (!reader.read(v) || reader.p != reader.end)
+        return Value();
+    return v;
+}
+
+bool Value::isBinary(std::string_view data)
+{
+    // messages are maps or compact arrays, JSON text starts with a brace, a
+    //  bracket or whitespace
+    if (data.empty())
+        return false;
+    unsigned char c = static_cast<unsigned char>(data[0]);
+    return (c & 0xe0) == 0x80 || (c >= 0xdc && c <= 0xdf);
+}
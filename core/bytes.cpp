@@ -0,0 +1,56 @@
+#include "bytes.h"
+
+#include <string.h>
+#include <utility>
+
+static void freeArray(void * data)
+{
+    delete [] static_cast<unsigned char *>(data);
+}
+
+Bytes::Bytes(size_t size)
+    : data_(size ? new unsigned char[size] : nullptr)
+    , size_(size)
+    , free_(freeArray)
+{
+}
+
+Bytes::Bytes(const void *data, size_t size)
+    : Bytes(size)
+{
+    if (size)
+        memcpy(data_, data, size);
+}
+
+Bytes::Bytes(Bytes &&o)
+    : data_(o.data_)
+    , size_(o.size_)
+    , free_(o.free_)
+{
+    o.data_ = nullptr;
+    o.size_ = 0;
+    o.free_ = nullptr;
+}
+
+Bytes &Bytes::operator=(Bytes &&o)
+{
+    std::swap(data_, o.data_);
+    std::swap(size_, o.size_);
+    std::swap(free_, o.free_);
+    return *this;
+}
+
+Bytes::~Bytes()
+{
+    if (data_ && free_)
+        free_(data_);
+}
+
+Bytes Bytes::adopt(void *data, size_t size, Free free)
+{
+    Bytes b;
+    b.data_ = static_cast<unsigned char *>(data);
+    b.size_ = size;
+    b.free_ = free;
+    return b;
+}
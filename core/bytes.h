@@ -0,0 +1,52 @@
+#ifndef BYTES_H
+#define BYTES_H
+
+#include "Hybridge_global.h"
+
+#include <cstddef>
+
+/*
+ * Move only binary buffer.
+ *
+ * Buffers from other owners can be adopted without copying, together with
+ *  the function that frees them.
+ */
+class HYBRIDGE_EXPORT Bytes
+{
+public:
+    typedef void (*Free)(void * data);
+
+    Bytes() = default;
+
+    explicit Bytes(size_t size);
+
+    Bytes(void const * data, size_t size);
+
+    Bytes(Bytes && o);
+
+    Bytes & operator=(Bytes && o);
+
+    Bytes(Bytes const & o) = delete;
+
+    Bytes & operator=(Bytes const & o) = delete;
+
+    ~Bytes();
+
+    static Bytes adopt(void * data, size_t size, Free free);
+
+public:
+    unsigned char * data() { return data_; }
+
+    unsigned char const * data() const { return data_; }
+
+    size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+private:
+    unsigned char * data_ = nullptr;
+    size_t size_ = 0;
+    Free free_ = nullptr;
+};
+
+#endif // BYTES_H
@@ -198,6 +198,40 @@ void Channel::setBlockUpdates(bool block)
     publisher_->setBlockUpdates(block);
 }
 
+/*!
+    Returns the number of property values, messages and (approximately) bytes not sent
+    because properties notified changes without changing their values.
+*/
+Channel::UpdateSavings Channel::updateSavings() const
+{
+    return publisher_->updateSavings_;
+}
+
+/*!
+    Sets the \a scheduler deciding when property changes are sent, the default one
+    sends them every 50 msec. The scheduler is not owned by the channel.
+
+    \sa UpdateScheduler
+*/
+void Channel::setUpdateScheduler(UpdateScheduler *scheduler)
+{
+    publisher_->scheduler_ = scheduler ? scheduler : &publisher_->defaultScheduler_;
+}
+
+UpdateScheduler *Channel::updateScheduler() const
+{
+    return publisher_->scheduler_;
+}
+
+/*!
+    Returns the number of property update flushes, the property values they sent and how
+    long the changes waited to be sent.
+*/
+Channel::UpdateMetrics Channel::updateMetrics() const
+{
+    return publisher_->updateMetrics_;
+}
+
 /*!
     Connects the Bridge to the given \a transport object.
 
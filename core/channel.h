@@ -5,6 +5,7 @@
 #include "metaobject.h"
 #include "message.h"
 
+#include <chrono>
 #include <map>
 #include <string>
 #include <vector>
@@ -13,6 +14,7 @@ class Transport;
 class Publisher;
 class ProxyObject;
 class Receiver;
+class UpdateScheduler;
 
 class HYBRIDGE_EXPORT Channel
 {
@@ -38,6 +40,36 @@ public:
 
     void setBlockUpdates(bool block);
 
+    // Property updates dropped because the value was unchanged since last sent
+    struct UpdateSavings
+    {
+        size_t values = 0;
+        size_t messages = 0;
+        size_t bytes = 0;
+    };
+
+    UpdateSavings updateSavings() const;
+
+    // Property changes are collected and sent as @p scheduler decides, it is
+    //  not owned. Pass nullptr for the default scheduler.
+    void setUpdateScheduler(UpdateScheduler * scheduler);
+
+    UpdateScheduler * updateScheduler() const;
+
+    // Property updates sent, a flush sends the changes due at a time
+    struct UpdateMetrics
+    {
+        size_t flushes = 0;
+        // values / flushes is the mean batch size
+        size_t values = 0;
+        size_t maxValues = 0;
+        // from the first change of the oldest object sent to the flush, summed
+        std::chrono::microseconds latency{0};
+        std::chrono::microseconds maxLatency{0};
+    };
+
+    UpdateMetrics updateMetrics() const;
+
 //Q_SIGNALS:
 //    void blockUpdatesChanged(bool block);
 
@@ -47,6 +79,11 @@ public:
     void disconnectFrom(Transport *transport);
 
 protected:
+    // The class information published for a MetaObject is cached, return
+    //  the same instance for all objects of a class. The cache is keyed by
+    //  its address and refers to its MetaProperty instances, they must stay
+    //  alive and unchanged until the last registered or wrapped object of
+    //  the class is destroyed, the cache entry is dropped then
     virtual MetaObject * metaObject(Object const * object) const = 0;
 
     virtual std::string createUuid() const = 0;
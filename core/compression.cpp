@@ -0,0 +1,147 @@
+#include "compression.h"
+
+#ifndef HYBRIDGE_NO_ZLIB
+#include <zlib.h>
+#endif
+
+#include <algorithm>
+
+#include <string.h>
+
+#ifndef HYBRIDGE_NO_ZLIB
+
+namespace {
+
+    // empty stored block ending a sync flush, implied at the end of frames
+    char const TAIL[] = {0, 0, '\xff', '\xff'};
+}
+
+struct Compression::Private
+{
+    z_stream deflater;
+    z_stream inflater;
+    bool deflating = false;
+    bool inflating = false;
+    size_t maxSize;
+    std::string scratch;
+};
+
+Compression::Compression(size_t maxSize)
+    : d_(new Private)
+{
+    memset(&d_->deflater, 0, sizeof(z_stream));
+    memset(&d_->inflater, 0, sizeof(z_stream));
+    d_->maxSize = maxSize;
+}
+
+Compression::~Compression()
+{
+    if (d_->deflating)
+        deflateEnd(&d_->deflater);
+    if (d_->inflating)
+        inflateEnd(&d_->inflater);
+    delete d_;
+}
+
+bool Compression::available()
+{
+    return true;
+}
+
+bool Compression::compress(std::string &data)
+{
+    z_stream & z = d_->deflater;
+    if (!d_->deflating) {
+        // raw deflate, the window is kept across frames
+        if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+        d_->deflating = true;
+    }
+    std::string & out = d_->scratch;
+    out.assign(1, MARKER);
+    z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    z.avail_in = static_cast<uInt>(data.size());
+    size_t used = 1;
+    do {
+        out.resize(used + deflateBound(&z, z.avail_in) + 8);
+        z.next_out = reinterpret_cast<Bytef *>(&out[used]);
+        z.avail_out = static_cast<uInt>(out.size() - used);
+        int r = deflate(&z, Z_SYNC_FLUSH);
+        if (r != Z_OK && r != Z_BUF_ERROR)
+            return false;
+        used = out.size() - z.avail_out;
+    } while (z.avail_out == 0);
+    if (used >= 5 && memcmp(&out[used - 4], TAIL, 4) == 0)
+        used -= 4;
+    out.resize(used);
+    data.swap(out);
+    return true;
+}
+
+bool Compression::decompress(std::string &data)
+{
+    if (!isCompressed(data))
+        return false;
+    z_stream & z = d_->inflater;
+    if (!d_->inflating) {
+        if (inflateInit2(&z, -15) != Z_OK)
+            return false;
+        d_->inflating = true;
+    }
+    data.append(TAIL, sizeof(TAIL));
+    z.next_in = reinterpret_cast<Bytef *>(&data[1]);
+    z.avail_in = static_cast<uInt>(data.size() - 1);
+    std::string & out = d_->scratch;
+    out.clear();
+    size_t used = 0;
+    for (;;) {
+        if (out.size() - used < 4096)
+            out.resize(std::max(out.size() * 2, used + 4 * data.size() + 4096));
+        z.next_out = reinterpret_cast<Bytef *>(&out[used]);
+        z.avail_out = static_cast<uInt>(out.size() - used);
+        int r = inflate(&z, Z_SYNC_FLUSH);
+        used = out.size() - z.avail_out;
+        // no progress possible, all input consumed
+        if (r == Z_BUF_ERROR && z.avail_in == 0)
+            break;
+        if (r != Z_OK || used > d_->maxSize)
+            return false;
+        if (z.avail_in == 0 && z.avail_out != 0)
+            break;
+    }
+    out.resize(used);
+    data.swap(out);
+    return true;
+}
+
+#else
+
+struct Compression::Private
+{
+};
+
+Compression::Compression(size_t)
+    : d_(nullptr)
+{
+}
+
+Compression::~Compression()
+{
+}
+
+bool Compression::available()
+{
+    return false;
+}
+
+bool Compression::compress(std::string &)
+{
+    return false;
+}
+
+bool Compression::decompress(std::string &)
+{
+    return false;
+}
+
+#endif
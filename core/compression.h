@@ -0,0 +1,54 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include "Hybridge_global.h"
+
+#include <string>
+#include <string_view>
+
+/*
+ * Streaming deflate context of one transport.
+ *
+ * Each direction keeps its window across frames, so keys and names repeated
+ *  from earlier messages compress to back references. Frames must be
+ *  decompressed in the order they were compressed.
+ *
+ * A compressed frame is the marker byte followed by raw deflate data flushed
+ *  to a byte boundary, without the trailing empty block (00 00 ff ff) as in
+ *  WebSocket permessage-deflate. The marker (0xc1) is never used by
+ *  MessagePack and can't start JSON text.
+ *
+ * Built without zlib (HYBRIDGE_NO_ZLIB), it is not available and fails.
+ */
+class HYBRIDGE_EXPORT Compression
+{
+public:
+    Compression(size_t maxSize = 64 * 1024 * 1024);
+
+    ~Compression();
+
+    Compression(Compression const & o) = delete;
+
+    Compression & operator=(Compression const & o) = delete;
+
+public:
+    static constexpr char MARKER = static_cast<char>(0xc1);
+
+    static bool available();
+
+    static bool isCompressed(std::string_view data) { return !data.empty() && data[0] == MARKER; }
+
+    // Replace @p data with its compressed frame
+    bool compress(std::string & data);
+
+    // Replace the compressed frame @p data with its content, fails if the
+    //  content is larger than the max size
+    bool decompress(std::string & data);
+
+private:
+    struct Private;
+
+    Private * d_;
+};
+
+#endif // COMPRESSION_H
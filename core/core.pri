@@ -1,15 +1,51 @@
 SOURCES += \
+    $$PWD/arena.cpp \
+    $$PWD/binary.cpp \
+    $$PWD/bytes.cpp \
     $$PWD/channel.cpp \
+    $$PWD/compression.cpp \
+    $$PWD/key.cpp \
     $$PWD/message.cpp \
     $$PWD/metaobject.cpp \
     $$PWD/proxyobject.cpp \
     $$PWD/transport.cpp \
+    $$PWD/updatescheduler.cpp \
     $$PWD/value.cpp
 
 HEADERS += \
+    $$PWD/arena.h \
+    $$PWD/bytes.h \
     $$PWD/channel.h \
+    $$PWD/compression.h \
+    $$PWD/flatmap.h \
+    $$PWD/jsonstream.h \
+    $$PWD/key.h \
     $$PWD/message.h \
     $$PWD/metaobject.h \
     $$PWD/proxyobject.h \
     $$PWD/transport.h \
+    $$PWD/updatescheduler.h \
     $$PWD/value.h
+
+# Frame compression (deflate) negotiated per transport, needs zlib. Use
+# CONFIG += no_zlib to build without it, compression is then never offered.
+no_zlib {
+    DEFINES += HYBRIDGE_NO_ZLIB
+} else {
+    LIBS += -lz
+}
+
+# SIMD paths of the rapidjson parser (whitespace skipping and string scanning),
+# picked in core/value.cpp from the instruction sets the compiler targets, SSE2
+# is baseline on x86_64. Use CONFIG += json_sse42 or json_avx2 to target newer
+# CPUs, both take the SSE4.2 path (rapidjson has no AVX2 one), or CONFIG +=
+# json_scalar to build the plain scalar parser.
+json_scalar {
+    DEFINES += HYBRIDGE_JSON_SCALAR
+} else: json_avx2 {
+    msvc: QMAKE_CXXFLAGS += /arch:AVX2
+    else: QMAKE_CXXFLAGS += -mavx2 -msse4.2
+} else: json_sse42 {
+    msvc: QMAKE_CXXFLAGS += /arch:AVX
+    else: QMAKE_CXXFLAGS += -msse4.2
+}
@@ -0,0 +1,193 @@
+#ifndef FLATMAP_H
+#define FLATMAP_H
+
+#include <vector>
+#include <utility>
+#include <functional>
+#include <memory>
+
+#include <stdint.h>
+
+/*
+ * Map with entries stored contiguously in insertion order.
+ *
+ * Small maps (like protocol messages) are searched linearly, larger ones
+ *  get an open addressing index of entry positions, kept up to date by
+ *  insertion and erasure. Lookups don't modify the map, const maps may be
+ *  read from several threads. Inserting may move entries, so unlike
+ *  std::map, references to entries are invalidated by insertion and erasure.
+ */
+template<typename K, typename V, typename A = std::allocator<std::pair<K, V>>>
+class FlatMap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<K, V> value_type;
+    typedef std::vector<value_type, A> container_type;
+    typedef typename container_type::iterator iterator;
+    typedef typename container_type::const_iterator const_iterator;
+
+    FlatMap() = default;
+
+    FlatMap(FlatMap && o) = default;
+
+    FlatMap & operator=(FlatMap && o) = default;
+
+    FlatMap(FlatMap const & o) = delete;
+
+    FlatMap & operator=(FlatMap const & o) = delete;
+
+public:
+    size_t size() const { return entries_.size(); }
+
+    bool empty() const { return entries_.empty(); }
+
+    void reserve(size_t n) { entries_.reserve(n); }
+
+    void clear() { entries_.clear(); index_.clear(); }
+
+    iterator begin() { return entries_.begin(); }
+
+    iterator end() { return entries_.end(); }
+
+    const_iterator begin() const { return entries_.begin(); }
+
+    const_iterator end() const { return entries_.end(); }
+
+    const_iterator cbegin() const { return entries_.cbegin(); }
+
+    const_iterator cend() const { return entries_.cend(); }
+
+    iterator find(K const & k) { return entries_.begin() + static_cast<ptrdiff_t>(indexOf(k)); }
+
+    const_iterator find(K const & k) const { return entries_.begin() + static_cast<ptrdiff_t>(indexOf(k)); }
+
+    size_t count(K const & k) const { return indexOf(k) == entries_.size() ? 0 : 1; }
+
+    V & operator[](K const & k)
+    {
+        size_t i = indexOf(k);
+        if (i == entries_.size())
+            append(K(k), V());
+        return entries_[i].second;
+    }
+
+    V & operator[](K && k)
+    {
+        size_t i = indexOf(k);
+        if (i == entries_.size())
+            append(std::move(k), V());
+        return entries_[i].second;
+    }
+
+    template<typename P>
+    std::pair<iterator, bool> insert(P && p)
+    {
+        return emplace(std::forward<P>(p).first, std::forward<P>(p).second);
+    }
+
+    template<typename KK, typename VV>
+    std::pair<iterator, bool> emplace(KK && k, VV && v)
+    {
+        K key(std::forward<KK>(k));
+        size_t i = indexOf(key);
+        bool inserted = i == entries_.size();
+        if (inserted)
+            append(std::move(key), V(std::forward<VV>(v)));
+        return std::make_pair(entries_.begin() + static_cast<ptrdiff_t>(i), inserted);
+    }
+
+    iterator erase(const_iterator it)
+    {
+        size_t i = static_cast<size_t>(it - entries_.cbegin());
+        entries_.erase(it);
+        reindex();
+        return entries_.begin() + static_cast<ptrdiff_t>(i);
+    }
+
+    iterator erase(iterator it)
+    {
+        return erase(const_iterator(it));
+    }
+
+    size_t erase(K const & k)
+    {
+        size_t i = indexOf(k);
+        if (i == entries_.size())
+            return 0;
+        erase(entries_.begin() + static_cast<ptrdiff_t>(i));
+        return 1;
+    }
+
+private:
+    // maps up to this size are searched linearly
+    static constexpr size_t LINEAR_MAX = 8;
+
+    typedef typename std::allocator_traits<A>::template rebind_alloc<uint32_t> IndexAllocator;
+
+    size_t indexOf(K const & k) const
+    {
+        size_t n = entries_.size();
+        if (n <= LINEAR_MAX) {
+            for (size_t i = 0; i < n; ++i) {
+                if (entries_[i].first == k)
+                    return i;
+            }
+            return n;
+        }
+        size_t mask = index_.size() - 1;
+        for (size_t s = std::hash<K>()(k) & mask; index_[s]; s = (s + 1) & mask) {
+            size_t i = index_[s] - 1;
+            if (entries_[i].first == k)
+                return i;
+        }
+        return n;
+    }
+
+    void append(K && k, V && v)
+    {
+        entries_.emplace_back(std::move(k), std::move(v));
+        if (entries_.size() <= LINEAR_MAX)
+            return;
+        if (entries_.size() * 2 > index_.size())
+            rehash();
+        else
+            place(entries_.size() - 1);
+    }
+
+    // positions moved after an erasure
+    void reindex()
+    {
+        if (entries_.size() <= LINEAR_MAX)
+            index_.clear();
+        else
+            rehash();
+    }
+
+    void rehash()
+    {
+        size_t n = 16;
+        while (n < entries_.size() * 2)
+            n *= 2;
+        index_.assign(n, 0);
+        for (size_t i = 0; i < entries_.size(); ++i)
+            place(i);
+    }
+
+    // slots hold entry position + 1, 0 for empty slots
+    void place(size_t i)
+    {
+        size_t mask = index_.size() - 1;
+        size_t s = std::hash<K>()(entries_[i].first) & mask;
+        while (index_[s])
+            s = (s + 1) & mask;
+        index_[s] = static_cast<uint32_t>(i + 1);
+    }
+
+private:
+    container_type entries_;
+    std::vector<uint32_t, IndexAllocator> index_;
+};
+
+#endif // FLATMAP_H
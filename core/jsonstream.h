@@ -0,0 +1,53 @@
+#ifndef JSONSTREAM_H
+#define JSONSTREAM_H
+
+#include "Hybridge_global.h"
+#include "value.h"
+
+#include <functional>
+
+/*
+ * Resumable parser for a stream of JSON messages.
+ *
+ * Chunks of any size, split anywhere, are fed as they arrive from a pipe or
+ *  a socket. The tokenizer and the layer stack of the value under
+ *  construction are kept between calls, the top level values completed by a
+ *  chunk are emitted once it is parsed. Messages may follow each other directly or separated
+ *  by whitespace.
+ *
+ * Nesting deeper than the max depth or a message larger than the max size
+ *  fails the stream, it has to be reset before feeding again.
+ *
+ * Shares the SAX handler of Value::fromJson, implemented in value.cpp.
+ */
+class HYBRIDGE_EXPORT JsonStream
+{
+public:
+    JsonStream(size_t maxDepth = 64, size_t maxSize = 64 * 1024 * 1024);
+
+    ~JsonStream();
+
+    JsonStream(JsonStream const & o) = delete;
+
+    JsonStream & operator=(JsonStream const & o) = delete;
+
+public:
+    /*
+     * Parse @p size bytes from @p data, calling @p emit for every completed
+     *  value. Returns false on a syntax error (including unescaped control
+     *  characters and lone surrogates in strings) or when a limit is exceeded.
+     */
+    bool feed(char const * data, size_t size, std::function<void (Value &&)> const & emit);
+
+    bool failed() const;
+
+    // Drop any partial value and the error state
+    void reset();
+
+private:
+    struct Private;
+
+    Private * d_;
+};
+
+#endif // JSONSTREAM_H
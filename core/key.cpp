@@ -0,0 +1,114 @@
+#include "key.h"
+
+#include <atomic>
+#include <forward_list>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+    // atoms found without locking, the rest only in the locked index
+    constexpr size_t FAST_SLOTS = 4096;
+    constexpr size_t FAST_MAX = FAST_SLOTS / 2;
+
+    struct Atoms
+    {
+        std::shared_mutex mutex;
+        std::forward_list<Key::Atom> atoms;
+        std::unordered_map<std::string_view, Key::Atom const *> index;
+        // open addressing by hash, slots are only ever filled
+        std::atomic<Key::Atom const *> slots[FAST_SLOTS] = {};
+        size_t fast = 0;
+        std::atomic<bool> overflow = { false };
+    };
+
+    Atoms & atoms()
+    {
+        static Atoms a;
+        return a;
+    }
+
+    // called with the mutex locked
+    void publish(Atoms & a, Key::Atom const * atom)
+    {
+        if (a.fast == FAST_MAX) {
+            a.overflow.store(true, std::memory_order_release);
+            return;
+        }
+        ++a.fast;
+        size_t s = atom->hash & (FAST_SLOTS - 1);
+        while (a.slots[s].load(std::memory_order_relaxed))
+            s = (s + 1) & (FAST_SLOTS - 1);
+        a.slots[s].store(atom, std::memory_order_release);
+    }
+
+    // atoms interned concurrently may be missed, the key then owns its string
+    Key::Atom const * findAtom(std::string_view s)
+    {
+        Atoms & a = atoms();
+        size_t h = std::hash<std::string_view>()(s);
+        for (size_t i = h & (FAST_SLOTS - 1); ; i = (i + 1) & (FAST_SLOTS - 1)) {
+            Key::Atom const * atom = a.slots[i].load(std::memory_order_acquire);
+            if (atom == nullptr)
+                break;
+            if (atom->hash == h && atom->str == s)
+                return atom;
+        }
+        if (!a.overflow.load(std::memory_order_acquire))
+            return nullptr;
+        std::shared_lock<std::shared_mutex> lock(a.mutex);
+        auto it = a.index.find(s);
+        return it == a.index.end() ? nullptr : it->second;
+    }
+}
+
+Key::Key(const char *s)
+    : Key(s, std::char_traits<char>::length(s))
+{
+}
+
+Key::Key(const char *s, size_t n)
+    : atom_(findAtom(std::string_view(s, n)))
+{
+    if (!atom_)
+        str_.assign(s, n);
+}
+
+Key::Key(const std::string &s)
+    : atom_(findAtom(s))
+{
+    if (!atom_)
+        str_ = s;
+}
+
+Key::Key(std::string &&s)
+    : atom_(findAtom(s))
+{
+    if (!atom_)
+        str_ = std::move(s);
+}
+
+Key Key::intern(const std::string &s)
+{
+    Key k;
+    k.atom_ = findAtom(s);
+    if (k.atom_)
+        return k;
+    Atoms & a = atoms();
+    std::unique_lock<std::shared_mutex> lock(a.mutex);
+    auto it = a.index.find(s);
+    if (it == a.index.end()) {
+        a.atoms.push_front(Atom{s, std::hash<std::string>()(s)});
+        it = a.index.emplace(a.atoms.front().str, &a.atoms.front()).first;
+        publish(a, it->second);
+    }
+    k.atom_ = it->second;
+    return k;
+}
+
+Key Key::intern(const char *s)
+{
+    return intern(std::string(s));
+}
@@ -0,0 +1,95 @@
+#ifndef KEY_H
+#define KEY_H
+
+#include "Hybridge_global.h"
+
+#include <string>
+#include <functional>
+
+/*
+ * Key of a Map entry.
+ *
+ * Interned keys point to one atom in a process wide table, holding the
+ *  string and its precomputed hash, every other key owns its string. A key
+ *  built from a string that equals an atom always resolves to that atom, so
+ *  comparing two interned keys is a pointer compare. Resolving a key takes
+ *  no lock, unless more than 2048 atoms exist.
+ *
+ * Protocol keys are interned statically, other frequently repeated names
+ *  (class, property and method names) are interned when first published.
+ *  Atoms are never released, don't intern unbounded sets of strings.
+ */
+class HYBRIDGE_EXPORT Key
+{
+public:
+    struct Atom
+    {
+        std::string str;
+        size_t hash;
+    };
+
+public:
+    Key() : atom_(nullptr) {}
+
+    Key(char const * s);
+
+    Key(char const * s, size_t n);
+
+    Key(std::string const & s);
+
+    Key(std::string && s);
+
+    static Key intern(std::string const & s);
+
+    static Key intern(char const * s);
+
+public:
+    bool isInterned() const { return atom_ != nullptr; }
+
+    std::string const & str() const { return atom_ ? atom_->str : str_; }
+
+    operator std::string const &() const { return str(); }
+
+    char const * c_str() const { return str().c_str(); }
+
+    size_t size() const { return str().size(); }
+
+    bool empty() const { return str().empty(); }
+
+    size_t hash() const { return atom_ ? atom_->hash : std::hash<std::string>()(str_); }
+
+    // keys interned after others with the same string were built fall back
+    //   to comparing strings
+    friend bool operator==(Key const & l, Key const & r)
+    {
+        if (l.atom_ && r.atom_)
+            return l.atom_ == r.atom_;
+        return l.str() == r.str();
+    }
+
+    friend bool operator!=(Key const & l, Key const & r)
+    {
+        return !(l == r);
+    }
+
+    friend bool operator<(Key const & l, Key const & r)
+    {
+        return l.str() < r.str();
+    }
+
+private:
+    Atom const * atom_;
+    std::string str_;
+};
+
+namespace std {
+
+template <>
+struct hash<Key>
+{
+    size_t operator()(Key const & k) const { return k.hash(); }
+};
+
+}
+
+#endif // KEY_H
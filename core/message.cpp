@@ -1,35 +1,148 @@
 #include "message.h"
 
+#include <assert.h>
+#include <charconv>
 #include <stdlib.h>
 
-const std::string KEY_SIGNALS = ("signals");
-const std::string KEY_METHODS = ("methods");
-const std::string KEY_PROPERTIES = ("properties");
-const std::string KEY_ENUMS = ("enums");
-const std::string KEY_Object = ("__Object*__");
-const std::string KEY_ID = ("id");
-const std::string KEY_DATA = ("data");
-const std::string KEY_CLASS = ("class");
-const std::string KEY_OBJECT = ("object");
-const std::string KEY_DESTROYED = ("destroyed");
-const std::string KEY_SIGNAL = ("signal");
-const std::string KEY_TYPE = ("type");
-const std::string KEY_METHOD = ("method");
-const std::string KEY_ARGS = ("args");
-const std::string KEY_PROPERTY = ("property");
-const std::string KEY_VALUE = ("value");
+const Key KEY_SIGNALS = Key::intern("signals");
+const Key KEY_METHODS = Key::intern("methods");
+const Key KEY_PROPERTIES = Key::intern("properties");
+const Key KEY_ENUMS = Key::intern("enums");
+const Key KEY_Object = Key::intern("__Object*__");
+const Key KEY_Bytes = Key::intern("__Bytes__");
+const Key KEY_ID = Key::intern("id");
+const Key KEY_DATA = Key::intern("data");
+const Key KEY_CLASS = Key::intern("class");
+const Key KEY_OBJECT = Key::intern("object");
+const Key KEY_DESTROYED = Key::intern("destroyed");
+const Key KEY_SIGNAL = Key::intern("signal");
+const Key KEY_TYPE = Key::intern("type");
+const Key KEY_METHOD = Key::intern("method");
+const Key KEY_ARGS = Key::intern("args");
+const Key KEY_PROPERTY = Key::intern("property");
+const Key KEY_VALUE = Key::intern("value");
+const Key KEY_CODEC = Key::intern("codec");
+const Key KEY_ENVELOPE = Key::intern("envelope");
+const Key KEY_BATCH = Key::intern("batch");
+const Key KEY_COMPRESSION = Key::intern("compression");
+
+const char CODEC_BINARY[] = "msgpack";
+const char ENVELOPE_COMPACT[] = "array";
+const char COMPRESSION_DEFLATE[] = "deflate";
+
+namespace {
+
+    // Compact layouts by message type, after the type itself
+    Key const MESSAGE_FIELDS[][5] = {
+        {}, // TypeInvalid
+        {KEY_OBJECT, KEY_SIGNAL, KEY_ARGS}, // TypeSignal
+        {KEY_DATA}, // TypePropertyUpdate
+        {KEY_ID}, // TypeInit
+        {KEY_DATA}, // TypeIdle
+        {KEY_DATA}, // TypeDebug
+        {KEY_ID, KEY_OBJECT, KEY_METHOD, KEY_ARGS}, // TypeInvokeMethod
+        {KEY_OBJECT, KEY_SIGNAL}, // TypeConnectToSignal
+        {KEY_OBJECT, KEY_SIGNAL}, // TypeDisconnectFromSignal
+        {KEY_OBJECT, KEY_PROPERTY, KEY_VALUE}, // TypeSetProperty
+        {KEY_ID, KEY_DATA}, // TypeResponse
+        {KEY_DATA}, // TypeBatch
+    };
+
+    // Position of @p key in a compact message of @p type, 0 if not a field
+    size_t fieldPosition(MessageType type, Key const & key)
+    {
+        Key const * fields = messageFields(type);
+        for (size_t i = 0; !fields[i].empty(); ++i) {
+            if (fields[i] == key)
+                return i + 1;
+        }
+        return 0;
+    }
+}
 
 char const * stringNumber(size_t n)
 {
-    static char str[16];
-#ifdef WIN32
-    _itoa_s(static_cast<int>(n), str, 10);
-#else
-    sprintf(str, "%ld", n);
-#endif
+    static thread_local char str[24];
+    *std::to_chars(str, str + sizeof(str) - 1, n).ptr = '\0';
     return str;
 }
 
+Message shareMessage(Message &message)
+{
+    Message shared;
+    shared.reserve(message.size());
+    for (auto & v : message)
+        shared.emplace(v.first, v.second.share());
+    return shared;
+}
+
+Key const * messageFields(MessageType type)
+{
+    return MESSAGE_FIELDS[type];
+}
+
+MessageType messageType(const Message &message)
+{
+    auto it = message.find(KEY_TYPE);
+    return it == message.end() ? TypeInvalid : toType(it->second);
+}
+
+MessageType messageType(const CompactMessage &message)
+{
+    return message.empty() ? TypeInvalid : toType(message.front());
+}
+
+void initMessage(Message &message, MessageType type)
+{
+    message[KEY_TYPE] = type;
+}
+
+void initMessage(CompactMessage &message, MessageType type)
+{
+    size_t n = 1;
+    for (Key const * fields = messageFields(type); !fields->empty(); ++fields)
+        ++n;
+    message.clear();
+    message.resize(n);
+    message.front() = type;
+}
+
+bool hasMessageField(const Message &message, const Key &key)
+{
+    return message.find(key) != message.end();
+}
+
+bool hasMessageField(const CompactMessage &message, const Key &key)
+{
+    size_t pos = fieldPosition(messageType(message), key);
+    return pos && pos < message.size();
+}
+
+Value & messageField(Message &message, const Key &key)
+{
+    static Value none;
+    auto it = message.find(key);
+    return it == message.end() ? none : it->second;
+}
+
+Value & messageField(CompactMessage &message, const Key &key)
+{
+    static Value none;
+    size_t pos = fieldPosition(messageType(message), key);
+    return pos && pos < message.size() ? message[pos] : none;
+}
+
+void setMessageField(Message &message, const Key &key, Value &&value)
+{
+    message[key] = std::move(value);
+}
+
+void setMessageField(CompactMessage &message, const Key &key, Value &&value)
+{
+    size_t pos = fieldPosition(messageType(message), key);
+    assert(pos && pos < message.size());
+    message[pos] = std::move(value);
+}
 
 MessageType toType(const Value &value)
 {
@@ -11,38 +11,93 @@ enum MessageType {
     TypeSignal = 1,
     TypePropertyUpdate = 2,
     TypeInit = 3,
-    TypeIdle = 4,
+    TypeIdle = 4, // acknowledges property updates, data: credits for more of them (1 if missing)
     TypeDebug = 5,
     TypeInvokeMethod = 6,
     TypeConnectToSignal = 7,
     TypeDisconnectFromSignal = 8,
     TypeSetProperty = 9,
     TypeResponse = 10,
+    TypeBatch = 11, // messages sent together in one frame, see Transport::flush()
 
-    TYPES_LAST_VALUE = 10
+    TYPES_LAST_VALUE = 11
 };
 
-extern const std::string KEY_SIGNALS;
-extern const std::string KEY_METHODS;
-extern const std::string KEY_PROPERTIES;
-extern const std::string KEY_ENUMS;
-extern const std::string KEY_Object; // special
-extern const std::string KEY_ID;
-extern const std::string KEY_DATA;
-extern const std::string KEY_CLASS;
-extern const std::string KEY_OBJECT;
-extern const std::string KEY_DESTROYED;
-extern const std::string KEY_SIGNAL;
-extern const std::string KEY_TYPE;
-extern const std::string KEY_METHOD;
-extern const std::string KEY_ARGS;
-extern const std::string KEY_PROPERTY;
-extern const std::string KEY_VALUE;
+extern const Key KEY_SIGNALS;
+extern const Key KEY_METHODS;
+extern const Key KEY_PROPERTIES;
+extern const Key KEY_ENUMS;
+extern const Key KEY_Object; // special
+extern const Key KEY_Bytes; // special
+extern const Key KEY_ID;
+extern const Key KEY_DATA;
+extern const Key KEY_CLASS;
+extern const Key KEY_OBJECT;
+extern const Key KEY_DESTROYED;
+extern const Key KEY_SIGNAL;
+extern const Key KEY_TYPE;
+extern const Key KEY_METHOD;
+extern const Key KEY_ARGS;
+extern const Key KEY_PROPERTY;
+extern const Key KEY_VALUE;
+extern const Key KEY_CODEC;
+extern const Key KEY_ENVELOPE;
+extern const Key KEY_BATCH;
+extern const Key KEY_COMPRESSION;
+
+// Value of KEY_CODEC, for the binary encoding negotiated at init
+extern const char CODEC_BINARY[];
+
+// Value of KEY_ENVELOPE, for the compact envelope negotiated at init
+extern const char ENVELOPE_COMPACT[];
+
+// Value of KEY_COMPRESSION, for frame compression negotiated at init
+extern const char COMPRESSION_DEFLATE[];
 
 typedef Map Message;
 
+/*
+ * Compact envelope: the type of the message followed by its fields by
+ *  position, in the order of messageFields(). The data of a property update
+ *  is an array of per object entries [object, signals, properties], with
+ *  the same IntMap values as the signals and properties of the map envelope.
+ *
+ * The init message and its response always use the map envelope.
+ */
+typedef Array CompactMessage;
+
 HYBRIDGE_EXPORT MessageType toType(const Value &value);
 
+// Fields of messages of @p type in compact order, ended by an empty key
+HYBRIDGE_EXPORT Key const * messageFields(MessageType type);
+
+HYBRIDGE_EXPORT MessageType messageType(Message const & message);
+
+HYBRIDGE_EXPORT MessageType messageType(CompactMessage const & message);
+
+// Start @p message, fields are set with setMessageField() in any order
+HYBRIDGE_EXPORT void initMessage(Message & message, MessageType type);
+
+HYBRIDGE_EXPORT void initMessage(CompactMessage & message, MessageType type);
+
+HYBRIDGE_EXPORT bool hasMessageField(Message const & message, Key const & key);
+
+HYBRIDGE_EXPORT bool hasMessageField(CompactMessage const & message, Key const & key);
+
+// Field @p key of @p message, a static None if it is missing
+HYBRIDGE_EXPORT Value & messageField(Message & message, Key const & key);
+
+HYBRIDGE_EXPORT Value & messageField(CompactMessage & message, Key const & key);
+
+HYBRIDGE_EXPORT void setMessageField(Message & message, Key const & key, Value && value);
+
+HYBRIDGE_EXPORT void setMessageField(CompactMessage & message, Key const & key, Value && value);
+
+// Decimal string of @p n, in a buffer of the calling thread valid until its next call
 HYBRIDGE_EXPORT char const * stringNumber(size_t n);
 
+// Share the values of @p message with a new message, the content is not
+//   copied. Use it to send one message to more than one transport.
+HYBRIDGE_EXPORT Message shareMessage(Message & message);
+
 #endif // MESSAGE_H
@@ -97,6 +97,12 @@ public:
 
 };
 
+/*
+ * Describes a class of objects to the channel. The channel identifies a class
+ *  by the address of its MetaObject and keeps pointers to its MetaProperty
+ *  instances, so these must stay alive and unchanged while any object of the
+ *  class is registered or wrapped, see Channel::metaObject().
+ */
 class HYBRIDGE_EXPORT MetaObject
 {
 public:
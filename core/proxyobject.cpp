@@ -28,6 +28,9 @@ public:
     virtual bool connect(const Connection & c) const override;
     virtual bool disconnect(const Connection &c) const override;
 
+public:
+    void setPropertyValue(size_t index, Value && value);
+
 private:
     const MetaMethod &method2(size_t index) const;
 
@@ -49,6 +52,11 @@ void ProxyObject::init(Receiver * receiver, std::string const & id)
     id_ = id;
 }
 
+void ProxyObject::updateProperty(size_t propertyIndex, Value &&value)
+{
+    static_cast<ProxyMetaObject *>(metaObj_)->setPropertyValue(propertyIndex, std::move(value));
+}
+
 const MetaProperty * ProxyObject::property(const char *name) const
 {
     std::string sname = name;
@@ -188,7 +196,8 @@ public:
     ProxyMetaEnum(std::string const & name, Map const & menum) : name_(name), menum_(menum) {}
 
 private:
-    std::string const & name_;
+    // copy, keys of the enums map move when it grows
+    std::string name_;
     Map const & menum_;
 
     // MetaEnum interface
@@ -216,16 +225,34 @@ bool ProxyMetaObject::disconnect(const Connection & c) const
     return po->receiver()->disconnectFromSignal(c);
 }
 
+// The class information lives as long as the proxy, not as the init message
+static Map persist(Map &&map)
+{
+    Map empty;
+    Value v = Value(std::move(map)).persist();
+    return std::move(v.toMap(empty));
+}
+
+// Many parameter types are parsed into a packed array, expand it here for
+//   the const accessors of ProxyMetaMethod
+static Array & methodInfo(Value & method, Array & dft)
+{
+    Array & info = method.toArray(dft);
+    if (info.size() > 3)
+        info[3].toArray(dft);
+    return info;
+}
+
 ProxyMetaObject::ProxyMetaObject(Map &&classinfo)
-    : classinfo_(std::move(classinfo))
+    : classinfo_(persist(std::move(classinfo)))
 {
     Array emptyArray;
     Array & signals = classinfo_[KEY_SIGNALS].toArray(emptyArray);
     for (Value & s : signals)
-        methods_.emplace_back(ProxyMetaMethod(s.toArray(emptyArray), true));
+        methods_.emplace_back(ProxyMetaMethod(methodInfo(s, emptyArray), true));
     Array & methods = classinfo_[KEY_METHODS].toArray(emptyArray);
     for (Value & m : methods)
-        methods_.emplace_back(ProxyMetaMethod(m.toArray(emptyArray), false));
+        methods_.emplace_back(ProxyMetaMethod(methodInfo(m, emptyArray), false));
     Map emptyMap;
     Map & enums = classinfo_[KEY_ENUMS].toMap(emptyMap);
     for (auto & e : enums)
@@ -240,6 +267,19 @@ ProxyMetaObject::ProxyMetaObject(Map &&classinfo)
     }
 }
 
+void ProxyMetaObject::setPropertyValue(size_t index, Value &&value)
+{
+    // the property infos are referenced by properties_, only their values change
+    Array emptyArray;
+    for (Value & v : classinfo_[KEY_PROPERTIES].toArray(emptyArray)) {
+        Array & propertyInfo = v.toArray(emptyArray);
+        if (static_cast<size_t>(propertyInfo.at(0).toInt()) == index) {
+            propertyInfo.at(3) = value.persist();
+            return;
+        }
+    }
+}
+
 const char *ProxyMetaEnum::key(size_t index) const
 {
     auto it = menum_.begin();
@@ -44,6 +44,9 @@ private:
 
     void init(Receiver * receiver, std::string const & id);
 
+    // Replace the value of property @p propertyIndex, on a property update
+    void updateProperty(size_t propertyIndex, Value && value);
+
 private:
     friend class Receiver;
     friend class ProxyMetaObject;
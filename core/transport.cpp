@@ -1,8 +1,13 @@
 #include "transport.h"
 #include "channel.h"
+#include "jsonstream.h"
+#include "compression.h"
 #include "priv/publisher.h"
 #include "priv/receiver.h"
 #include "priv/collection.h"
+#include "priv/debug.h"
+
+#include <assert.h>
 
 /*!
     \class Transport
@@ -50,6 +55,8 @@ Transport::~Transport()
     if (publisher_) {
         publisher_->channel_->disconnectFrom(this);
     }
+    delete stream_;
+    delete compression_;
 }
 
 void Transport::setPublisher(Publisher * publisher)
@@ -62,12 +69,225 @@ void Transport::setReceiver(Receiver *receiver)
     receiver_ = receiver;
 }
 
+void Transport::sendCompactMessage(CompactMessage &&message)
+{
+    // never negotiated without an override
+    (void) message;
+    assert(false);
+}
+
+void Transport::sendFrame(Value &&frame)
+{
+    // never used without an override
+    (void) frame;
+    assert(false);
+}
+
+void Transport::flush()
+{
+    if (batched_.empty())
+        return;
+    Array messages = std::move(batched_);
+    batched_.clear();
+    Array emptyArray;
+    Map emptyMap;
+    if (messages.size() == 1) {
+        Value & message = messages.front();
+        if (message.isArray())
+            sendCompactMessage(std::move(message.toArray(emptyArray)));
+        else
+            sendMessage(std::move(message.toMap(emptyMap)));
+        return;
+    }
+    if (compact_) {
+        CompactMessage batch;
+        initMessage(batch, TypeBatch);
+        setMessageField(batch, KEY_DATA, std::move(messages));
+        sendCompactMessage(std::move(batch));
+    } else {
+        Message batch;
+        initMessage(batch, TypeBatch);
+        setMessageField(batch, KEY_DATA, std::move(messages));
+        sendMessage(std::move(batch));
+    }
+}
+
+void Transport::setBatchLimits(size_t maxMessages, int maxLatency)
+{
+    batchMaxMessages_ = maxMessages;
+    batchMaxLatency_ = maxLatency;
+}
+
+void Transport::post(Message &&message)
+{
+    if (batching())
+        enqueue(std::move(message));
+    else
+        sendMessage(std::move(message));
+}
+
+void Transport::post(CompactMessage &&message)
+{
+    if (batching())
+        enqueue(std::move(message));
+    else
+        sendCompactMessage(std::move(message));
+}
+
+bool Transport::batching()
+{
+    if (!batch_)
+        return false;
+    if (batched_.empty()) {
+        if (!scheduleFlush())
+            return false;
+        batchStart_ = std::chrono::steady_clock::now();
+    }
+    return true;
+}
+
+void Transport::enqueue(Value &&message)
+{
+    batched_.emplace_back(std::move(message));
+    if (batched_.size() >= batchMaxMessages_
+            || std::chrono::steady_clock::now() - batchStart_ >= std::chrono::milliseconds(batchMaxLatency_))
+        flush();
+}
+
+void Transport::unbatch(Value &messages)
+{
+    Array emptyArray;
+    Map emptyMap;
+    for (Value & message : messages.toArray(emptyArray)) {
+        if (message.isArray())
+            messageReceived(std::move(message.toArray(emptyArray)));
+        else
+            messageReceived(std::move(message.toMap(emptyMap)));
+    }
+}
+
 void Transport::messageReceived(Message &&message)
 {
     const MessageType type = toType(mapValue(message, KEY_TYPE));
+    if (type == TypeBatch) {
+        unbatch(mapValue(message, KEY_DATA));
+        return;
+    }
+    if (receiver_ && (type == TypeSignal || type == TypePropertyUpdate || type == TypeResponse)) {
+        receiver_->handleMessage(std::move(message));
+    } else {
+        publisher_->handleMessage(std::move(message), this);
+    }
+}
+
+void Transport::messageReceived(CompactMessage &&message)
+{
+    const MessageType type = messageType(message);
+    if (type == TypeBatch) {
+        unbatch(messageField(message, KEY_DATA));
+        return;
+    }
     if (receiver_ && (type == TypeSignal || type == TypePropertyUpdate || type == TypeResponse)) {
         receiver_->handleMessage(std::move(message));
     } else {
         publisher_->handleMessage(std::move(message), this);
     }
 }
+
+void Transport::messageReceived(std::string &&data)
+{
+    if (Compression::isCompressed(data)) {
+        if (compression_ == nullptr)
+            compression_ = new Compression;
+        if (!compression_->decompress(data)) {
+            warning("Failed to decompress a message frame");
+            return;
+        }
+    }
+    Value message = Value::isBinary(data) ? Value::fromBinary(std::move(data))
+                                          : Value::fromJsonLazy(std::move(data));
+    if (message.isArray()) {
+        Array empty;
+        messageReceived(std::move(message.toArray(empty)));
+        return;
+    }
+    Map empty;
+    messageReceived(std::move(message.toMap(empty)));
+}
+
+std::string const & Transport::serialize(Message const &message)
+{
+    encode(message);
+    return compressBuffer();
+}
+
+std::string const & Transport::serialize(CompactMessage const &message)
+{
+    encode(message);
+    return compressBuffer();
+}
+
+std::string const & Transport::encode(Message const &message)
+{
+    buffer_.clear();
+    if (binary_)
+        Value::writeBinary(message, buffer_);
+    else
+        Value::writeJson(message, buffer_);
+    return buffer_;
+}
+
+std::string const & Transport::encode(CompactMessage const &message)
+{
+    buffer_.clear();
+    if (binary_)
+        Value::writeBinary(message, buffer_);
+    else
+        Value::writeJson(message, buffer_);
+    return buffer_;
+}
+
+void Transport::postFrame(Value &&frame)
+{
+    Bytes const & bytes = frame.toBytes();
+    if (!compress_ || bytes.size() < compressionThreshold_) {
+        sendFrame(std::move(frame));
+        return;
+    }
+    // the deflate window is our own, compress a copy
+    buffer_.assign(reinterpret_cast<char const *>(bytes.data()), bytes.size());
+    compressBuffer();
+    sendFrame(Value(Bytes(buffer_.data(), buffer_.size())));
+}
+
+void Transport::setCompressed(bool compressed)
+{
+    compress_ = compressed;
+    if (compressed && compression_ == nullptr)
+        compression_ = new Compression;
+}
+
+std::string const & Transport::compressBuffer()
+{
+    if (compress_ && buffer_.size() >= compressionThreshold_ && !compression_->compress(buffer_)) {
+        // the stream is broken, the peer still reads plain frames
+        warning("Failed to compress a message frame");
+        compress_ = false;
+    }
+    return buffer_;
+}
+
+bool Transport::dataReceived(const char *data, size_t size)
+{
+    if (stream_ == nullptr)
+        stream_ = new JsonStream;
+    return stream_->feed(data, size, [this](Value && message) {
+        if (message.isArray()) {
+            Array empty;
+            messageReceived(std::move(message.toArray(empty)));
+            return;
+        }
+        Map empty;
+        messageReceived(std::move(message.toMap(empty)));
+    });
+}
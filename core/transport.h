@@ -3,9 +3,14 @@
 
 #include "Hybridge_global.h"
 #include "message.h"
+#include "bytes.h"
+
+#include <chrono>
 
 class Publisher;
 class Receiver;
+class JsonStream;
+class Compression;
 
 class HYBRIDGE_EXPORT Transport
 {
@@ -21,16 +26,189 @@ public:
 public:
     virtual void sendMessage(Message &&message) = 0;
 
+    /*
+     * Whether this transport carries binary frames. If both ends do, the
+     *  binary encoding is negotiated at init, otherwise messages are JSON.
+     */
+    virtual bool supportsBinary() const { return false; }
+
+    bool isBinary() const { return binary_; }
+
+    /*
+     * Send a message in the compact envelope, instead of sendMessage(), once
+     *  it is negotiated at init. That happens only if supportsCompact() is
+     *  overridden to return true.
+     */
+    virtual void sendCompactMessage(CompactMessage &&message);
+
+    virtual bool supportsCompact() const { return false; }
+
+    bool isCompact() const { return compact_; }
+
+    /*
+     * Whether this transport carries binary frames and may compress them. If
+     *  both ends do, serialized frames of at least the compression threshold
+     *  are deflated, negotiated at init. Frames are inflated in order.
+     */
+    virtual bool supportsCompression() const { return false; }
+
+    bool isCompressed() const { return compress_; }
+
+    void setCompressionThreshold(size_t size) { compressionThreshold_ = size; }
+
+    /*
+     * Send a frame already serialized (and compressed, if negotiated) for
+     *  this transport, instead of sendMessage(). Broadcasts encode a message
+     *  once for all transports of the same encoding and envelope, that happens
+     *  only if supportsFrames() is overridden to return true. Transports with
+     *  batches negotiated still get messages.
+     *
+     * @p frame holds Bytes, shared with other transports. Keep a reference
+     *  (share()) rather than copying it, to send it later.
+     */
+    virtual void sendFrame(Value &&frame);
+
+    virtual bool supportsFrames() const { return false; }
+
+    /*
+     * Build a message in the negotiated envelope and send it, @p build is
+     *  called with an empty Message or CompactMessage. The message may be
+     *  queued for a batch.
+     */
+    template<typename F>
+    void send(F && build)
+    {
+        if (compact_) {
+            CompactMessage message;
+            build(message);
+            post(std::move(message));
+        } else {
+            Message message;
+            build(message);
+            post(std::move(message));
+        }
+    }
+
+    // Send the messages queued for a batch, see scheduleFlush()
+    void flush();
+
+    // A batch is flushed early once it holds @p maxMessages messages, or
+    //  when its first message is older than @p maxLatency milliseconds
+    void setBatchLimits(size_t maxMessages, int maxLatency);
+
     void setPublisher(Publisher * publisher);
 
     void setReceiver(Receiver * receiver);
 
 protected:
+    /*
+     * Once the peer accepts batches (negotiated at init), outbound messages
+     *  are queued and sent together as one TypeBatch message by flush(). The
+     *  first message of a batch calls this, to arrange a call to flush()
+     *  before the event loop waits again. Return false (the default) to send
+     *  every message on its own.
+     */
+    virtual bool scheduleFlush() { return false; }
+
+    // Batches are unpacked, handling their messages in order
     void messageReceived(Message &&message);
 
+    void messageReceived(CompactMessage &&message);
+
+    // Parse the top level of @p data and handle it, members like arguments
+    //  are decoded only when used. Binary encoded and compact messages are
+    //  detected.
+    void messageReceived(std::string &&data);
+
+    /*
+     * Encode @p message with the negotiated encoding (JSON by default) into a
+     *  buffer owned by this transport, compressed if negotiated and large
+     *  enough. The buffer is reused by every call and the result is valid
+     *  until the next.
+     */
+    std::string const & serialize(Message const &message);
+
+    std::string const & serialize(CompactMessage const &message);
+
+    /*
+     * Feed a chunk of a stream of JSON messages, for transports without
+     *  message framing. Each message is handled as soon as it is complete,
+     *  returns false if the stream is broken.
+     */
+    bool dataReceived(char const *data, size_t size);
+
+private:
+    friend class Publisher;
+    friend class Receiver;
+
+    void setBinary(bool binary) { binary_ = binary; }
+
+    void setCompact(bool compact) { compact_ = compact; }
+
+    void setBatch(bool batch) { batch_ = batch; }
+
+    void setCompressed(bool compressed);
+
+    std::string const & compressBuffer();
+
+    // Encode @p message into the buffer, without compression
+    std::string const & encode(Message const &message);
+
+    std::string const & encode(CompactMessage const &message);
+
+    // Whether a broadcast may send a frame encoded for another transport
+    bool takesFrames() const { return batch_ == false && supportsFrames(); }
+
+    // Transports with the same format take the same frames
+    int frameFormat() const { return (binary_ ? 1 : 0) | (compact_ ? 2 : 0); }
+
+    // Build a message with @p build and encode it into a shared frame
+    template<typename F>
+    Value encodeFrame(F const & build)
+    {
+        std::string const * data;
+        if (compact_) {
+            CompactMessage message;
+            build(message);
+            data = &encode(message);
+        } else {
+            Message message;
+            build(message);
+            data = &encode(message);
+        }
+        Value frame(Bytes(data->data(), data->size()));
+        return frame.share();
+    }
+
+    // Send @p frame, compressed by this transport if negotiated
+    void postFrame(Value &&frame);
+
+    void post(Message &&message);
+
+    void post(CompactMessage &&message);
+
+    // Whether to queue the next message, starting a batch if needed
+    bool batching();
+
+    void enqueue(Value &&message);
+
+    void unbatch(Value &messages);
+
 private:
     Publisher * publisher_ = nullptr;
     Receiver * receiver_ = nullptr;
+    std::string buffer_;
+    JsonStream * stream_ = nullptr;
+    bool binary_ = false;
+    bool compact_ = false;
+    bool batch_ = false;
+    Array batched_;
+    std::chrono::steady_clock::time_point batchStart_;
+    size_t batchMaxMessages_ = 256;
+    int batchMaxLatency_ = 10;
+    Compression * compression_ = nullptr;
+    size_t compressionThreshold_ = 1024;
+    bool compress_ = false;
 };
 
 #endif // TRANSPORT_H
@@ -0,0 +1,84 @@
+#include "updatescheduler.h"
+
+#include <algorithm>
+
+UpdateScheduler::UpdateScheduler(int interval)
+    : interval_(interval)
+{
+}
+
+UpdateScheduler::~UpdateScheduler()
+{
+}
+
+int UpdateScheduler::interval(const Object *object, size_t propertyIndex)
+{
+    if (!objects_.empty()) {
+        auto it = objects_.find(object);
+        if (it != objects_.end()) {
+            auto p = it->second.properties.find(propertyIndex);
+            if (p != it->second.properties.end())
+                return p->second;
+            if (it->second.interval >= 0)
+                return it->second.interval;
+        }
+    }
+    // changes after a pause are not held back by the load before it
+    if (isAdaptive() && interval_ > minInterval_
+            && std::chrono::steady_clock::now() - lastFlush_ > std::chrono::milliseconds(interval_) * 4) {
+        interval_ = minInterval_;
+    }
+    return interval_;
+}
+
+void UpdateScheduler::flushed(size_t values, std::chrono::microseconds latency)
+{
+    (void) latency;
+    lastFlush_ = std::chrono::steady_clock::now();
+    if (!isAdaptive())
+        return;
+    if (values >= highValues_)
+        interval_ = std::min(std::max(interval_ * 2, 1), maxInterval_);
+    else if (values <= lowValues_)
+        interval_ = std::max(interval_ / 2, minInterval_);
+}
+
+void UpdateScheduler::objectDestroyed(const Object *object)
+{
+    objects_.erase(object);
+}
+
+void UpdateScheduler::setInterval(int msec)
+{
+    interval_ = msec;
+    maxInterval_ = 0;
+}
+
+void UpdateScheduler::setInterval(const Object *object, int msec)
+{
+    ObjectIntervals &intervals = objects_[object];
+    intervals.interval = msec;
+    if (msec < 0 && intervals.properties.empty())
+        objects_.erase(object);
+}
+
+void UpdateScheduler::setInterval(const Object *object, size_t propertyIndex, int msec)
+{
+    ObjectIntervals &intervals = objects_[object];
+    if (msec >= 0)
+        intervals.properties[propertyIndex] = msec;
+    else
+        intervals.properties.erase(propertyIndex);
+    if (intervals.interval < 0 && intervals.properties.empty())
+        objects_.erase(object);
+}
+
+void UpdateScheduler::setAdaptive(int minInterval, int maxInterval, size_t lowValues, size_t highValues)
+{
+    minInterval_ = minInterval;
+    maxInterval_ = maxInterval;
+    lowValues_ = lowValues;
+    highValues_ = highValues;
+    if (isAdaptive())
+        interval_ = std::min(std::max(interval_, minInterval_), maxInterval_);
+}
@@ -0,0 +1,80 @@
+#ifndef UPDATESCHEDULER_H
+#define UPDATESCHEDULER_H
+
+#include "Hybridge_global.h"
+#include "metaobject.h"
+
+#include <chrono>
+#include <unordered_map>
+
+/*
+ * Decides how long property changes are collected before they are sent to
+ *  the clients. Changes are grouped per object, the changed properties of an
+ *  object are sent together once the shortest of their intervals has passed.
+ *
+ * By default all properties share one interval. Objects and single properties
+ *  may get their own, IMMEDIATE sends them with the next turn of the event
+ *  loop. In adaptive mode the shared interval doubles after flushes with many
+ *  values, halves after flushes with few, and drops to its minimum when the
+ *  changes pause.
+ *
+ * Derive to implement other policies, see Channel::setUpdateScheduler().
+ */
+class HYBRIDGE_EXPORT UpdateScheduler
+{
+public:
+    static constexpr int IMMEDIATE = 0;
+
+    UpdateScheduler(int interval = 50);
+
+    virtual ~UpdateScheduler();
+
+public:
+    // Interval in msec to collect changes of @p propertyIndex of @p object
+    virtual int interval(Object const * object, size_t propertyIndex);
+
+    // A flush sent @p values property values, the oldest change waited @p latency
+    virtual void flushed(size_t values, std::chrono::microseconds latency);
+
+    // Forget what is set for @p object, it is destroyed
+    virtual void objectDestroyed(Object const * object);
+
+public:
+    // The shared interval, the current one in adaptive mode
+    int interval() const { return interval_; }
+
+    void setInterval(int msec);
+
+    // A negative @p msec removes the interval of the object or property
+    void setInterval(Object const * object, int msec);
+
+    void setInterval(Object const * object, size_t propertyIndex, int msec);
+
+    /*
+     * Adapt the shared interval between @p minInterval and @p maxInterval,
+     *  growing after flushes of at least @p highValues values and shrinking
+     *  after flushes of at most @p lowValues. A @p maxInterval of 0 ends the
+     *  adaptive mode.
+     */
+    void setAdaptive(int minInterval, int maxInterval,
+                     size_t lowValues = 16, size_t highValues = 256);
+
+    bool isAdaptive() const { return maxInterval_ > 0; }
+
+private:
+    struct ObjectIntervals
+    {
+        int interval = -1;
+        std::unordered_map<size_t, int> properties;
+    };
+
+    int interval_;
+    int minInterval_ = 0;
+    int maxInterval_ = 0;
+    size_t lowValues_ = 0;
+    size_t highValues_ = 0;
+    std::chrono::steady_clock::time_point lastFlush_;
+    std::unordered_map<Object const *, ObjectIntervals> objects_;
+};
+
+#endif // UPDATESCHEDULER_H
@@ -1,17 +1,744 @@
 #include "value.h"
+#include "message.h"
+#include "jsonstream.h"
+
+// SIMD paths of the parser, by the instruction sets the compiler targets.
+//   MSVC defines no SSE4.2 macro, /arch:AVX implies it. The bundled rapidjson
+//   (1.1.0) has no NEON path.
+#if !defined(HYBRIDGE_JSON_SCALAR) && !defined(RAPIDJSON_SSE2) && !defined(RAPIDJSON_SSE42)
+#if defined(__SSE4_2__) || defined(__AVX__)
+#define RAPIDJSON_SSE42
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAPIDJSON_SSE2
+#endif
+#endif
 
 #include <rapidjson/reader.h>
 #include <rapidjson/writer.h>
-#include <rapidjson/stringbuffer.h>
 
+#include <atomic>
+#include <charconv>
+#include <climits>
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <stdlib.h>
+#include <string.h>
 
 Map const Value::dftMap;
 Array const Value::dftArray;
+Bytes const Value::dftBytes;
+IntArray const Value::dftIntArray;
+LongArray const Value::dftLongArray;
+FloatArray const Value::dftFloatArray;
+DoubleArray const Value::dftDoubleArray;
+IntMap const Value::dftIntMap;
 
 static Map emptyMap;
 static Array emptyArray;
 
+static char const base64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string toBase64(Bytes const & b)
+{
+    std::string s;
+    s.reserve((b.size() + 2) / 3 * 4);
+    unsigned char const * p = b.data();
+    size_t n = b.size();
+    for (size_t i = 0; i < n; i += 3) {
+        unsigned v = static_cast<unsigned>(p[i]) << 16;
+        if (i + 1 < n) v |= static_cast<unsigned>(p[i + 1]) << 8;
+        if (i + 2 < n) v |= p[i + 2];
+        s.push_back(base64Chars[(v >> 18) & 0x3f]);
+        s.push_back(base64Chars[(v >> 12) & 0x3f]);
+        s.push_back(i + 1 < n ? base64Chars[(v >> 6) & 0x3f] : '=');
+        s.push_back(i + 2 < n ? base64Chars[v & 0x3f] : '=');
+    }
+    return s;
+}
+
+static Bytes fromBase64(std::string_view s)
+{
+    static struct Table
+    {
+        signed char d[256];
+        Table()
+        {
+            for (int i = 0; i < 256; ++i) d[i] = -1;
+            for (int i = 0; i < 64; ++i) d[static_cast<unsigned char>(base64Chars[i])] = static_cast<signed char>(i);
+        }
+    } const table;
+    size_t digits = 0;
+    for (char c : s) {
+        if (table.d[static_cast<unsigned char>(c)] >= 0)
+            ++digits;
+    }
+    Bytes b(digits * 6 / 8);
+    size_t n = 0;
+    unsigned v = 0;
+    int bits = 0;
+    for (char c : s) {
+        signed char d = table.d[static_cast<unsigned char>(c)];
+        if (d < 0)
+            continue;
+        v = (v << 6) | static_cast<unsigned>(d);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            b.data()[n++] = static_cast<unsigned char>(v >> bits);
+        }
+    }
+    return b;
+}
+
+// interned strings live forever, reference them instead of copying
+Value::Value(Key const & k)
+    : Value(k.isInterned() ? Value(String, static_cast<void const *>(&k.str())) : Value(k.str()))
+{
+}
+
+Value Value::view(const char *data, size_t size)
+{
+    Value v;
+    v.u_.p = Arena::create<Slice>(Slice{data, size, nullptr, nullptr, false});
+    v.t_ = String;
+    v.r_ = View;
+    return v;
+}
+
+Value Value::raw(const char *data, size_t size, Type type, Array *blobs)
+{
+    Value v;
+    v.u_.p = Arena::create<Slice>(Slice{data, size, nullptr, blobs, false});
+    v.t_ = type;
+    v.r_ = Raw;
+    return v;
+}
+
+Value Value::rawCopy() const
+{
+    Slice * s = static_cast<Slice *>(u_.p);
+    s->copied = true;
+    Arena::Scope scope(s);
+    Value v = raw(s->data, s->size, t_, s->blobs);
+    static_cast<Slice *>(v.u_.p)->copied = true;
+    return v;
+}
+
+std::string_view Value::rawJson() const
+{
+    if (r_ != Raw)
+        return std::string_view();
+    Slice * s = static_cast<Slice *>(u_.p);
+    return std::string_view(s->data, s->size);
+}
+
+std::string *Value::materialize() const
+{
+    Slice * s = static_cast<Slice *>(u_.p);
+    if (s->str == nullptr)
+        s->str = Arena::create<std::string>(s->data, s->size);
+    return s->str;
+}
+
+struct Value::SharedNode
+{
+    std::atomic<size_t> refs;
+    Value value;
+};
+
+void * Value::indirect() const
+{
+    if (r_ == View)
+        return materialize();
+    if (r_ == Raw) {
+        decode();
+        return ptr();
+    }
+    return static_cast<SharedNode *>(u_.p)->value.ptr();
+}
+
+void Value::release()
+{
+    if (r_ == View || r_ == Raw) {
+        Slice * s = static_cast<Slice *>(u_.p);
+        if (s->str)
+            Arena::destroy(s->str);
+        Arena::destroy(s);
+    } else if (r_ == Share) {
+        SharedNode * n = static_cast<SharedNode *>(u_.p);
+        if (--n->refs == 0)
+            Arena::destroy(n);
+    }
+}
+
+Value Value::share()
+{
+    if (r_ == Raw)
+        decode();
+    if (r_ == Share) {
+        ++static_cast<SharedNode *>(u_.p)->refs;
+        Value v;
+        v.u_ = u_;
+        v.t_ = t_;
+        v.r_ = Share;
+        return v;
+    }
+    if ((r_ != Val && r_ != View) || isInline(t_))
+        return ref();
+    SharedNode * n = Arena::create<SharedNode>();
+    n->refs = 1;
+    n->value = std::move(*this);
+    u_.p = n;
+    t_ = n->value.t_;
+    r_ = Share;
+    return share();
+}
+
+// Mutable access to a shared node, take the content if we are the only
+//   owner, otherwise make our own copy. Handles are shallow const, like
+//   references are.
+void Value::detach() const
+{
+    Value & self = const_cast<Value &>(*this);
+    SharedNode * n = static_cast<SharedNode *>(u_.p);
+    Value v = n->refs == 1 ? std::move(n->value) : n->value.copy();
+    self = std::move(v);
+}
+
+bool operator==(const Value &l, const Value &r)
+{
+    Value::Type t = l.type();
+    if (t != r.type())
+        return false;
+    // handles of the same shared node, or references to the same instance
+    if (l.r_ != Value::Val && l.r_ == r.r_ && l.u_.p == r.u_.p)
+        return true;
+    switch (t) {
+    case Value::None: return true;
+    case Value::Bool: return l.toBool() == r.toBool();
+    case Value::Int: return l.toInt() == r.toInt();
+    case Value::Long: return l.toLong() == r.toLong();
+    case Value::Float: return l.toFloat() == r.toFloat();
+    case Value::Double: return l.toDouble() == r.toDouble();
+    case Value::String: return l.toStringView() == r.toStringView();
+    case Value::Array_: {
+        Array const & la = l.toArray();
+        Array const & ra = r.toArray();
+        if (la.size() != ra.size())
+            return false;
+        for (size_t i = 0; i < la.size(); ++i) {
+            if (la[i] != ra[i])
+                return false;
+        }
+        return true;
+    }
+    case Value::Map_: {
+        Map const & lm = l.toMap();
+        Map const & rm = r.toMap();
+        if (lm.size() != rm.size())
+            return false;
+        for (auto const & e : lm) {
+            auto it = rm.find(e.first);
+            if (it == rm.end() || e.second != it->second)
+                return false;
+        }
+        return true;
+    }
+    case Value::Object_: return l.toObject() == r.toObject();
+    case Value::Bytes_: {
+        Bytes const & lb = l.toBytes();
+        Bytes const & rb = r.toBytes();
+        return lb.size() == rb.size() && (lb.size() == 0 || memcmp(lb.data(), rb.data(), lb.size()) == 0);
+    }
+    case Value::IntArray_: return l.toIntArray() == r.toIntArray();
+    case Value::LongArray_: return l.toLongArray() == r.toLongArray();
+    case Value::FloatArray_: return l.toFloatArray() == r.toFloatArray();
+    case Value::DoubleArray_: return l.toDoubleArray() == r.toDoubleArray();
+    case Value::IntMap_: {
+        IntMap const & lm = l.toIntMap();
+        IntMap const & rm = r.toIntMap();
+        if (lm.size() != rm.size())
+            return false;
+        for (auto const & e : lm) {
+            auto it = rm.find(e.first);
+            if (it == rm.end() || e.second != it->second)
+                return false;
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+static size_t hashCombine(size_t h, size_t v)
+{
+    return h ^ (v + 0x9e3779b9 + (h << 6) + (h >> 2));
+}
+
+// 0.0 and -0.0 compare equal, hash them equally
+template<typename T>
+static size_t hashNumber(T n)
+{
+    return std::hash<T>()(n == T(0) ? T(0) : n);
+}
+
+template<typename P>
+static size_t hashPacked(size_t h, P const & p)
+{
+    for (auto n : p)
+        h = hashCombine(h, hashNumber(n));
+    return h;
+}
+
+size_t Value::hash() const
+{
+    Type t = type();
+    size_t h = std::hash<int>()(t);
+    switch (t) {
+    case None: return h;
+    case Bool: return hashCombine(h, toBool());
+    case Int: return hashCombine(h, hashNumber(toInt()));
+    case Long: return hashCombine(h, hashNumber(toLong()));
+    case Float: return hashCombine(h, hashNumber(toFloat()));
+    case Double: return hashCombine(h, hashNumber(toDouble()));
+    case String: return hashCombine(h, std::hash<std::string_view>()(toStringView()));
+    case Array_:
+        for (Value const & v : toArray())
+            h = hashCombine(h, v.hash());
+        return h;
+    case Map_: {
+        // entries may be in any order, sum them up
+        size_t sum = 0;
+        for (auto const & e : toMap())
+            sum += hashCombine(e.first.hash(), e.second.hash());
+        return hashCombine(h, sum);
+    }
+    case Object_: return hashCombine(h, std::hash<Object *>()(toObject()));
+    case Bytes_: {
+        Bytes const & b = toBytes();
+        return hashCombine(h, std::hash<std::string_view>()(
+                               std::string_view(reinterpret_cast<char const *>(b.data()), b.size())));
+    }
+    case IntArray_: return hashPacked(h, toIntArray());
+    case LongArray_: return hashPacked(h, toLongArray());
+    case FloatArray_: return hashPacked(h, toFloatArray());
+    case DoubleArray_: return hashPacked(h, toDoubleArray());
+    case IntMap_: {
+        size_t sum = 0;
+        for (auto const & e : toIntMap())
+            sum += hashCombine(std::hash<int>()(e.first), e.second.hash());
+        return hashCombine(h, sum);
+    }
+    }
+    return h;
+}
+
+template<typename P>
+static Array unpackArray(P const & p)
+{
+    Array a;
+    a.reserve(p.size());
+    for (auto e : p)
+        a.emplace_back(e);
+    return a;
+}
+
+// @p v as an element of a packed array of E, converted like scalars are
+template<typename E>
+static E packedElement(Value const & v)
+{
+    if constexpr (std::is_same<E, int>::value)
+        return v.toInt();
+    else if constexpr (std::is_same<E, long long>::value)
+        return v.toLong();
+    else if constexpr (std::is_same<E, float>::value)
+        return v.toFloat();
+    else
+        return v.toDouble();
+}
+
+template<typename P>
+static P packArray(Array const & a)
+{
+    P p;
+    p.reserve(a.size());
+    for (Value const & v : a)
+        p.push_back(packedElement<typename P::value_type>(v));
+    return p;
+}
+
+template<typename P, typename F>
+static P repackArray(F const & f)
+{
+    typedef typename P::value_type E;
+    typedef typename F::value_type S;
+    if constexpr (sizeof(E) >= sizeof(S) ? std::is_floating_point<E>::value || std::is_integral<S>::value
+                                         : std::is_floating_point<E>::value && std::is_integral<S>::value) {
+        return P(f.begin(), f.end());
+    } else {
+        // narrowing, elements out of range are 0 as scalars are
+        P p;
+        p.reserve(f.size());
+        for (S e : f)
+            p.push_back(packedElement<E>(Value(e)));
+        return p;
+    }
+}
+
+Value Value::clone() const
+{
+    switch (type()) {
+    case None: return Value();
+    case Bool: return value(false);
+    case Int: return value(0);
+    case Long: return value(0LL);
+    case Float: return value(0.0f);
+    case Double: return value(0.0);
+    case String: return std::string(toStringView());
+    case Array_: {
+        Array const & a = toArray();
+        Array c;
+        c.reserve(a.size());
+        for (Value const & v : a)
+            c.emplace_back(v.clone());
+        return c;
+    }
+    case Map_: {
+        Map const & m = toMap();
+        Map c;
+        c.reserve(m.size());
+        for (auto const & v : m)
+            c.emplace(v.first, v.second.clone());
+        return c;
+    }
+    case Object_: return toObject();
+    case Bytes_: {
+        Bytes const & b = toBytes();
+        return Bytes(b.data(), b.size());
+    }
+    case IntArray_: return repackArray<IntArray>(toIntArray());
+    case LongArray_: return repackArray<LongArray>(toLongArray());
+    case FloatArray_: return repackArray<FloatArray>(toFloatArray());
+    case DoubleArray_: return repackArray<DoubleArray>(toDoubleArray());
+    case IntMap_: {
+        IntMap const & m = toIntMap();
+        IntMap c;
+        c.reserve(m.size());
+        for (auto const & v : m)
+            c.emplace(v.first, v.second.clone());
+        return c;
+    }
+    }
+    return Value();
+}
+
+Value Value::persist() const
+{
+    Arena::Heap heap;
+    return clone();
+}
+
+Value Value::copy() const
+{
+    if (r_ == Raw)
+        return rawCopy();
+    if (r_ == Share) {
+        ++static_cast<SharedNode *>(u_.p)->refs;
+        Value v;
+        v.u_ = u_;
+        v.t_ = t_;
+        v.r_ = Share;
+        return v;
+    }
+    switch (t_) {
+    case Array_: {
+        Array const & a = toArray();
+        Array c;
+        c.reserve(a.size());
+        for (Value const & v : a)
+            c.emplace_back(v.copy());
+        return c;
+    }
+    case Map_: {
+        Map const & m = toMap();
+        Map c;
+        c.reserve(m.size());
+        for (auto const & v : m)
+            c.emplace(v.first, v.second.copy());
+        return c;
+    }
+    case IntMap_: {
+        IntMap const & m = toIntMap();
+        IntMap c;
+        c.reserve(m.size());
+        for (auto const & v : m)
+            c.emplace(v.first, v.second.copy());
+        return c;
+    }
+    default:
+        return clone();
+    }
+}
+
+void Value::unpack() const
+{
+    Array a;
+    switch (t_) {
+    case IntArray_: a = unpackArray(toIntArray()); break;
+    case LongArray_: a = unpackArray(toLongArray()); break;
+    case FloatArray_: a = unpackArray(toFloatArray()); break;
+    case DoubleArray_: a = unpackArray(toDoubleArray()); break;
+    default: return;
+    }
+    const_cast<Value &>(*this) = Value(std::move(a));
+}
+
+std::string_view Value::toStringView(std::string_view dft) const
+{
+    if (t_ != String)
+        return dft;
+    if (r_ == Share)
+        return static_cast<SharedNode *>(u_.p)->value.toStringView(dft);
+    if (r_ == View) {
+        Slice * s = static_cast<Slice *>(u_.p);
+        // materialized copies may have been modified
+        if (s->str)
+            return *s->str;
+        return std::string_view(s->data, s->size);
+    }
+    return *reinterpret_cast<std::string *>(u_.p);
+}
+
+long long Value::parseLong(std::string_view s, long long dflt)
+{
+    long long n = 0;
+    auto r = std::from_chars(s.data(), s.data() + s.size(), n);
+    if (r.ec == std::errc() && r.ptr == s.data() + s.size())
+        return n;
+    // "1.5e3", or too large
+    return cast(parseDouble(s, std::numeric_limits<double>::quiet_NaN()), dflt);
+}
+
+double Value::parseDouble(std::string_view s, double dflt)
+{
+    // strtod needs a terminated string, numbers are short
+    char buf[64];
+    if (s.empty() || s.size() >= sizeof(buf))
+        return dflt;
+    s.copy(buf, s.size());
+    buf[s.size()] = '\0';
+    char * end = nullptr;
+    double d = strtod(buf, &end);
+    return end == buf + s.size() ? d : dflt;
+}
+
+// Decimal map key, as written for IntMap keys
+static bool parseIndex(std::string_view s, int & n)
+{
+    auto r = std::from_chars(s.data(), s.data() + s.size(), n);
+    return r.ec == std::errc() && r.ptr == s.data() + s.size();
+}
+
+bool Value::canConvert(Type type) const
+{
+    if (r_ == Raw)
+        decode();
+    if (t_ == type)
+        return true;
+    // base64 strings, from clients without binary support
+    if (t_ == String && type == Bytes_)
+        return true;
+    // packed and plain arrays convert among each other
+    if ((t_ == Array_ || isPacked(t_)) && (type == Array_ || isPacked(type)))
+        return true;
+    if (t_ == IntMap_ && type == Map_)
+        return true;
+    if (t_ == Map_ && type == IntMap_) {
+        int n;
+        for (auto const & e : toMap()) {
+            if (!parseIndex(e.first.str(), n))
+                return false;
+        }
+        return true;
+    }
+    bool from = t_ >= Bool && t_ <= String;
+    bool to = type >= Bool && type <= String;
+    return from && to;
+}
+
+template<typename P>
+static P toPacked(Value const & v)
+{
+    switch (v.type()) {
+    case Value::IntArray_: return repackArray<P>(v.toIntArray());
+    case Value::LongArray_: return repackArray<P>(v.toLongArray());
+    case Value::FloatArray_: return repackArray<P>(v.toFloatArray());
+    case Value::DoubleArray_: return repackArray<P>(v.toDoubleArray());
+    default: return packArray<P>(v.toArray());
+    }
+}
+
+Value Value::convert(Type type) const &
+{
+    if (!canConvert(type))
+        return Value();
+    switch (type) {
+    case Bool: return value(false);
+    case Int: return value(0);
+    case Long: return value(0LL);
+    case Float: return value(0.0f);
+    case Double: return value(0.0);
+    case Bytes_: return fromBase64(toStringView());
+    case Array_: {
+        if (t_ == Array_)
+            return clone();
+        Value v = ref();
+        v.unpack();
+        return v;
+    }
+    case IntArray_: return toPacked<IntArray>(*this);
+    case LongArray_: return toPacked<LongArray>(*this);
+    case FloatArray_: return toPacked<FloatArray>(*this);
+    case DoubleArray_: return toPacked<DoubleArray>(*this);
+    case Map_: {
+        if (t_ == Map_)
+            return clone();
+        Map m;
+        m.reserve(toIntMap().size());
+        char buf[16];
+        for (auto const & e : toIntMap()) {
+            auto r = std::to_chars(buf, buf + sizeof(buf), e.first);
+            m.emplace(::Key(buf, static_cast<size_t>(r.ptr - buf)), e.second.clone());
+        }
+        return m;
+    }
+    case IntMap_: {
+        if (t_ == IntMap_)
+            return clone();
+        IntMap m;
+        m.reserve(toMap().size());
+        int n = 0;
+        for (auto const & e : toMap()) {
+            parseIndex(e.first.str(), n);
+            m.emplace(n, e.second.clone());
+        }
+        return m;
+    }
+    case String:
+        switch (t_) {
+        case Bool: return std::string(value(false) ? "true" : "false");
+        case Int: return std::to_string(value(0));
+        case Long: return std::to_string(value(0LL));
+        case Float: return std::to_string(value(0.0f));
+        case Double: return std::to_string(value(0.0));
+        default: return std::string(toStringView());
+        }
+    default: return Value();
+    }
+}
+
+Value Value::convert(Type type) &&
+{
+    if (r_ == Raw)
+        decode();
+    // only owned content is moved, not that of referenced or shared values
+    if (r_ != Val || !canConvert(type))
+        return static_cast<Value const &>(*this).convert(type);
+    switch (type) {
+    case Array_:
+        if (t_ == Array_)
+            return std::move(*this);
+        break;
+    case Map_: {
+        if (t_ == Map_)
+            return std::move(*this);
+        IntMap & im = *static_cast<IntMap *>(ptr());
+        Map m;
+        m.reserve(im.size());
+        char buf[16];
+        for (auto & e : im) {
+            auto r = std::to_chars(buf, buf + sizeof(buf), e.first);
+            m.emplace(::Key(buf, static_cast<size_t>(r.ptr - buf)), std::move(e.second));
+        }
+        return m;
+    }
+    case IntMap_: {
+        if (t_ == IntMap_)
+            return std::move(*this);
+        Map & mm = *static_cast<Map *>(ptr());
+        IntMap m;
+        m.reserve(mm.size());
+        int n = 0;
+        for (auto & e : mm) {
+            parseIndex(e.first.str(), n);
+            m.emplace(n, std::move(e.second));
+        }
+        return m;
+    }
+    default:
+        break;
+    }
+    return static_cast<Value const &>(*this).convert(type);
+}
+
+Value Value::ref() const
+{
+    if (r_ == Raw)
+        decode();
+    Value v;
+    if (r_ == Val && isInline(t_)) {
+        // inline scalars are cheap, copy them instead of referencing
+        //   storage that moves with this value
+        v.u_ = u_;
+        v.t_ = t_;
+        v.r_ = Val;
+        return v;
+    }
+    if (r_ == View) {
+        v.u_.p = materialize();
+        v.t_ = t_;
+        v.r_ = CRef;
+        return v;
+    }
+    if (r_ == Share) {
+        // keep the node alive, instead of referencing into it
+        return const_cast<Value *>(this)->share();
+    }
+    v.u_.p = u_.p;
+    v.t_ = t_;
+    v.r_ = r_ == CRef ? CRef : Ref;
+    return v;
+}
+
+Value Value::adopt(Type t, void * v)
+{
+    Value vl(t, v);
+    vl.r_ = Val;
+    if (isInline(t)) {
+        switch (t) {
+        case Bool: vl.u_.b = *reinterpret_cast<bool*>(v); delete reinterpret_cast<bool*>(v); break;
+        case Int: vl.u_.i = *reinterpret_cast<int*>(v); delete reinterpret_cast<int*>(v); break;
+        case Long: vl.u_.l = *reinterpret_cast<long long*>(v); delete reinterpret_cast<long long*>(v); break;
+        case Float: vl.u_.f = *reinterpret_cast<float*>(v); delete reinterpret_cast<float*>(v); break;
+        case Double: vl.u_.d = *reinterpret_cast<double*>(v); delete reinterpret_cast<double*>(v); break;
+        default: vl.u_.p = *reinterpret_cast<Object**>(v); delete reinterpret_cast<Object**>(v); break;
+        }
+    } else {
+        // owned nodes are allocated through Arena, move into one of those
+        switch (t) {
+        case String: vl.u_.p = Arena::create<std::string>(std::move(*reinterpret_cast<std::string*>(v)));
+            delete reinterpret_cast<std::string*>(v); break;
+        case Array_: vl.u_.p = Arena::create<Array>(std::move(*reinterpret_cast<Array*>(v)));
+            delete reinterpret_cast<Array*>(v); break;
+        case Map_: vl.u_.p = Arena::create<Map>(std::move(*reinterpret_cast<Map*>(v)));
+            delete reinterpret_cast<Map*>(v); break;
+        default: vl.r_ = Ref; break;
+        }
+    }
+    return vl;
+}
+
 using namespace rapidjson;
 
 struct MyHandler
@@ -28,23 +755,127 @@ struct MyHandler
     struct Layer
     {
         State s = None;
-		std::string key;
+        ::Key key;
         Value v;
     };
 
+    // arrays of numbers are packed once they have this many elements
+    static constexpr size_t PACK_MIN_SIZE = 16;
+
     std::vector<Layer> stack;
+    // strings reference the parse buffer kept by the current arena
+    bool insitu;
+    // Bytes transfered in a side channel
+    Array * blobs;
 
-    MyHandler()
+    MyHandler(bool insitu = false, Array * blobs = nullptr)
+        : insitu(insitu)
+        , blobs(blobs)
     {
         stack.push_back(Layer());
     }
 
+    // {"__Bytes__": "<base64>"} or {"__Bytes__": <blob index>}
+    Value bytes(Value && v) {
+        Map const & m = v.toMap();
+        if (m.size() != 1 || m.begin()->first != KEY_Bytes)
+            return std::move(v);
+        Value const & b = m.begin()->second;
+        if (b.isString())
+            return fromBase64(b.toStringView());
+        // only an integer in range is an index, not null, floats or strings
+        //   converted to one
+        if (!blobs || (b.type() != Value::Int && b.type() != Value::Long))
+            return std::move(v);
+        long long n = b.toLong();
+        if (n < 0 || static_cast<unsigned long long>(n) >= blobs->size())
+            return std::move(v);
+        size_t index = static_cast<size_t>(n);
+        if ((*blobs)[index].isBytes()) {
+            // copies of raw JSON may decode the same index again
+            if (!insitu) {
+                Bytes const & b = (*blobs)[index].toBytes();
+                return Bytes(b.data(), b.size());
+            }
+            return std::move((*blobs)[index]);
+        }
+        return std::move(v);
+    }
+
+    // Numbers are appended to a packed array of their type, an array of
+    //   ints is widened to longs
+    template<typename P, typename T>
+    static void push(Value & a, T t) {
+        if (a.t_ != Value::TypeOf<P>::value)
+            a = repackArray<P>(a.toIntArray());
+        static_cast<P *>(a.ptr())->push_back(static_cast<typename P::value_type>(t));
+    }
+
+    // Pack the plain array @p a if it holds only integers or only doubles,
+    //   integers in the narrowest type holding all of them. Doubles would
+    //   change the type of integers, and lose precision of large longs.
+    static void pack(Value & a) {
+        Value::Type type = Value::None;
+        // the tag, raw elements of lazy parsing are not decoded
+        for (Value const & e : a.toArray()) {
+            switch (e.t_) {
+            case Value::Int: if (type == Value::None) type = Value::Int; break;
+            case Value::Long: if (type != Value::Double) type = Value::Long; break;
+            case Value::Double: if (type == Value::None) type = Value::Double; break;
+            default: return;
+            }
+            if ((type == Value::Double) != (e.t_ == Value::Double))
+                return;
+        }
+        switch (type) {
+        case Value::Int: a = packArray<IntArray>(a.toArray()); break;
+        case Value::Long: a = packArray<LongArray>(a.toArray()); break;
+        default: a = packArray<DoubleArray>(a.toArray()); break;
+        }
+    }
+
+    // Short lists (like method arguments) are kept plain, with the original
+    //   values, longer ones of only numbers are packed
+    static void element(Value & a, Value && v) {
+        if (!a.isPackedArray()) {
+            Array & array = a.toArray(emptyArray);
+            array.emplace_back(std::move(v));
+            if (array.size() == PACK_MIN_SIZE)
+                pack(a);
+            return;
+        }
+        switch (v.t_) {
+        case Value::Int:
+            if (a.isDoubleArray())
+                break;
+            if (a.isIntArray())
+                push<IntArray>(a, v.u_.i);
+            else
+                push<LongArray>(a, v.u_.i);
+            return;
+        case Value::Long:
+            if (a.isDoubleArray())
+                break;
+            push<LongArray>(a, v.u_.l);
+            return;
+        case Value::Double:
+            if (!a.isDoubleArray())
+                break;
+            push<DoubleArray>(a, v.u_.d);
+            return;
+        default:
+            break;
+        }
+        // other values, or doubles and integers mixed, unpack
+        a.toArray(emptyArray).emplace_back(std::move(v));
+    }
+
     bool Value_(Value && v) {
         Layer & l = stack.back();
         if (l.s == InArray) {
-            l.v.toArray(emptyArray).emplace_back(std::move(v));
+            element(l.v, std::move(v));
         } else if (l.s == InValue) {
-            l.v.toMap(emptyMap).insert(std::make_pair(l.key, std::move(v)));
+            l.v.toMap(emptyMap).emplace(std::move(l.key), std::move(v));
             l.s = InObject;
         } else {
             return false;
@@ -56,18 +887,20 @@ struct MyHandler
     bool Bool(bool b) { return Value_(b); }
     bool Int(int i) { return Value_(i); }
     bool Uint(unsigned u) { return (u & 0x80000000) ? Uint64(u) : Value_(static_cast<int>(u)); }
-    bool Int64(int64_t i) { return Value_(i); }
+    bool Int64(int64_t i) { return Value_(static_cast<long long>(i)); }
     bool Uint64(uint64_t u) { return Value_(static_cast<long long>(u)); }
     bool Double(double d) { return Value_(d); }
     bool RawNumber(const char* str, SizeType length, bool /*copy*/) { return Value_(std::string(str, length)); }
-    bool String(const char* str, SizeType length, bool /*copy*/) { return Value_(std::string(str, length)); }
+    bool String(const char* str, SizeType length, bool /*copy*/) {
+        return Value_(insitu ? Value::view(str, length) : Value(std::string(str, length)));
+    }
     bool StartObject() {
         Layer & l = stack.back();
         if (l.s == None) {
             l.s = InObject;
             l.v = Map();
         } else if (l.s == InArray || l.s == InValue) {
-            Layer l2 = { InObject, "", Map() };
+            Layer l2 = { InObject, ::Key(), Map() };
             stack.emplace_back(std::move(l2));
         } else {
             return false;
@@ -77,7 +910,7 @@ struct MyHandler
     bool Key(const char* str, SizeType length, bool /*copy*/) {
         Layer & l = stack.back();
         if (l.s == InObject) {
-            l.key = std::string(str, length);
+            l.key = ::Key(str, length);
             l.s = InValue;
             return true;
         }
@@ -90,7 +923,7 @@ struct MyHandler
                 l.s = End;
                 return true;
             } else {
-                Value v = std::move(l.v);
+                Value v = bytes(std::move(l.v));
                 stack.pop_back();
                 return Value_(std::move(v));
             }
@@ -103,7 +936,7 @@ struct MyHandler
             l.s = InArray;
             l.v = Array();
         } else if (l.s == InArray || l.s == InValue) {
-            Layer l2 = { InArray, "", Array() };
+            Layer l2 = { InArray, ::Key(), Array() };
             stack.emplace_back(std::move(l2));
         } else {
             return false;
@@ -126,42 +959,195 @@ struct MyHandler
     }
 };
 
-static void writeValue(Writer<StringBuffer> & writer, Value const & v)
-{
-    if (v.isInt())
-        writer.Int(v.toInt());
-    else if (v.isLong())
-        writer.Int64(v.toLong());
-    else if (v.isBool())
-        writer.Bool(v.toBool());
-    else if (v.isFloat())
-        writer.Double(static_cast<double>(v.toFloat()));
-    else if (v.isDouble())
-        writer.Double(v.toDouble());
-    else if (v.isString())
-        writer.String(v.toString().c_str());
-    else if (v.isArray()) {
-        Array const & a = v.toArray();
-        writer.StartArray();
-        for (Value const & v2 : a) {
-            writeValue(writer, v2);
+// Builds the top level of a message, object and array members are skipped
+//   and kept as raw JSON slices of the buffer
+struct LazyHandler : MyHandler
+{
+    char const * buffer;
+    StringStream * ss = nullptr;
+    // nesting inside the skipped member
+    size_t depth = 0;
+    size_t start = 0;
+
+    LazyHandler(char const * buffer, Array * blobs)
+        : MyHandler(false, blobs)
+        , buffer(buffer)
+    {
+    }
+
+    // Members of a top level object, or elements of a top level array (as
+    //   compact messages are)
+    bool skip() {
+        if (depth == 0 && (stack.size() != 1 || (stack.back().s != InValue && stack.back().s != InArray)))
+            return false;
+        // the reader has taken the bracket already
+        if (depth++ == 0)
+            start = ss->Tell() - 1;
+        return true;
+    }
+
+    bool end(Value::Type type) {
+        if (--depth > 0)
+            return true;
+        return Value_(Value::raw(buffer + start, ss->Tell() - start, type, blobs));
+    }
+
+    bool Null() { return depth || MyHandler::Null(); }
+    bool Bool(bool b) { return depth || MyHandler::Bool(b); }
+    bool Int(int i) { return depth || MyHandler::Int(i); }
+    bool Uint(unsigned u) { return depth || MyHandler::Uint(u); }
+    bool Int64(int64_t i) { return depth || MyHandler::Int64(i); }
+    bool Uint64(uint64_t u) { return depth || MyHandler::Uint64(u); }
+    bool Double(double d) { return depth || MyHandler::Double(d); }
+    bool RawNumber(const char* str, SizeType length, bool copy) { return depth || MyHandler::RawNumber(str, length, copy); }
+    bool String(const char* str, SizeType length, bool copy) { return depth || MyHandler::String(str, length, copy); }
+    bool Key(const char* str, SizeType length, bool copy) { return depth || MyHandler::Key(str, length, copy); }
+    bool StartObject() { return skip() || MyHandler::StartObject(); }
+    bool EndObject(SizeType memberCount) { return depth ? end(Value::Map_) : MyHandler::EndObject(memberCount); }
+    bool StartArray() { return skip() || MyHandler::StartArray(); }
+    bool EndArray(SizeType elementCount) { return depth ? end(Value::Array_) : MyHandler::EndArray(elementCount); }
+};
+
+void Value::decode() const
+{
+    Slice * s = static_cast<Slice *>(u_.p);
+    Value v;
+    {
+        // the tree joins the message, its strings stay in the buffer, unless
+        //   other values reference the same JSON
+        Arena::Scope scope(s);
+        MyHandler handler(!s->copied, s->blobs);
+        Reader reader;
+        // the slice is followed by the rest of the message
+        if (s->copied) {
+            StringStream ss(s->data);
+            if (reader.Parse<kParseStopWhenDoneFlag>(ss, handler))
+                v = handler.bytes(std::move(handler.stack.front().v));
+        } else {
+            InsituStringStream ss(const_cast<char *>(s->data));
+            if (reader.Parse<kParseInsituFlag | kParseStopWhenDoneFlag>(ss, handler))
+                v = handler.bytes(std::move(handler.stack.front().v));
         }
-        writer.EndArray(static_cast<unsigned>(a.size()));
-    } else if (v.isMap()) {
-        Map const & n = v.toMap();
+    }
+    const_cast<Value &>(*this) = std::move(v);
+}
+
+// Appends to a caller owned string, so its capacity is reused across messages
+struct StringOutput
+{
+    typedef char Ch;
+    std::string & str;
+    void Put(char c) { str.push_back(c); }
+    void Flush() {}
+};
+
+typedef Writer<StringOutput> JsonWriter;
+
+static void writeNumber(JsonWriter & writer, int n) { writer.Int(n); }
+static void writeNumber(JsonWriter & writer, long long n) { writer.Int64(n); }
+// shortest round trip form of the float, not of the widened double
+static void writeNumber(JsonWriter & writer, float n)
+{
+    if (!std::isfinite(n)) {
+        writer.Double(static_cast<double>(n));
+        return;
+    }
+    char buf[32];
+    auto r = std::to_chars(buf, buf + sizeof(buf), n);
+    writer.RawValue(buf, static_cast<size_t>(r.ptr - buf), kNumberType);
+}
+static void writeNumber(JsonWriter & writer, double n) { writer.Double(n); }
+
+template<typename P>
+static void writePacked(JsonWriter & writer, P const & a)
+{
+    writer.StartArray();
+    for (auto n : a)
+        writeNumber(writer, n);
+    writer.EndArray(static_cast<SizeType>(a.size()));
+}
+
+static void writeValue(JsonWriter & writer, Value const & v, Array * blobs);
+
+// Writes the content of a value, as dispatched by Value::visit
+struct JsonVisitor
+{
+    JsonWriter & writer;
+    Array * blobs;
+
+    void operator()(std::nullptr_t) { writer.Null(); }
+    void operator()(bool b) { writer.Bool(b); }
+    void operator()(int n) { writeNumber(writer, n); }
+    void operator()(long long n) { writeNumber(writer, n); }
+    void operator()(float n) { writeNumber(writer, n); }
+    void operator()(double n) { writeNumber(writer, n); }
+    void operator()(std::string_view s) { writer.String(s.data(), static_cast<SizeType>(s.size())); }
+    void operator()(Object *) { writer.Null(); }
+    void operator()(IntArray const & a) { writePacked(writer, a); }
+    void operator()(LongArray const & a) { writePacked(writer, a); }
+    void operator()(FloatArray const & a) { writePacked(writer, a); }
+    void operator()(DoubleArray const & a) { writePacked(writer, a); }
+
+    void operator()(IntMap const & m) {
+        char buf[16];
         writer.StartObject();
-        for (auto const & v2 : n) {
-            writer.Key(v2.first.c_str());
-            writeValue(writer, v2.second);
+        for (auto const & e : m) {
+            auto r = std::to_chars(buf, buf + sizeof(buf), e.first);
+            writer.Key(buf, static_cast<SizeType>(r.ptr - buf));
+            writeValue(writer, e.second, blobs);
         }
-        writer.EndObject(static_cast<unsigned>(n.size()));
-    } else {
-        writer.Null();
+        writer.EndObject(static_cast<SizeType>(m.size()));
     }
+
+    void operator()(Array const & a) {
+        writer.StartArray();
+        for (Value const & v : a)
+            writeValue(writer, v, blobs);
+        writer.EndArray(static_cast<SizeType>(a.size()));
+    }
+
+    void operator()(Map const & m) {
+        writer.StartObject();
+        for (auto const & e : m) {
+            writer.Key(e.first.c_str(), static_cast<SizeType>(e.first.size()));
+            writeValue(writer, e.second, blobs);
+        }
+        writer.EndObject(static_cast<SizeType>(m.size()));
+    }
+
+    // inline form, blobs for a side channel are handled by writeValue
+    void operator()(Bytes const & b) {
+        writer.StartObject();
+        writer.Key(KEY_Bytes.c_str(), static_cast<SizeType>(KEY_Bytes.size()));
+        std::string s = toBase64(b);
+        writer.String(s.data(), static_cast<SizeType>(s.size()));
+        writer.EndObject(1);
+    }
+};
+
+static void writeValue(JsonWriter & writer, Value const & v, Array * blobs)
+{
+    std::string_view raw = v.rawJson();
+    if (!raw.empty()) {
+        writer.RawValue(raw.data(), raw.size(), raw[0] == '{' ? kObjectType : kArrayType);
+        return;
+    }
+    if (blobs && v.isBytes()) {
+        writer.StartObject();
+        writer.Key(KEY_Bytes.c_str(), static_cast<SizeType>(KEY_Bytes.size()));
+        writer.Uint64(blobs->size());
+        blobs->emplace_back(v.ref());
+        writer.EndObject(1);
+        return;
+    }
+    v.visit(JsonVisitor{writer, blobs});
 }
 
 Value Value::fromJson(const std::string &json)
 {
+    // the parsed tree is allocated from one arena, and released in one step
+    //   when the last value of it is destroyed
+    Arena::Scope scope;
     MyHandler handler;
     Reader reader;
     StringStream ss(json.c_str());
@@ -171,14 +1157,424 @@ Value Value::fromJson(const std::string &json)
         return Value();
 }
 
+Value Value::fromJson(std::string &&json)
+{
+    return fromJson(std::move(json), Array());
+}
+
+Value Value::fromJson(std::string &&json, Array &&blobs)
+{
+    Arena::Scope scope;
+    // the arena owns the buffer now, views into it are valid as long as
+    //   any value of the tree is alive
+    char * buffer = &(*Arena::keep(std::move(json)))[0];
+    MyHandler handler(true, &blobs);
+    Reader reader;
+    InsituStringStream ss(buffer);
+    if (reader.Parse<kParseInsituFlag>(ss, handler))
+        return std::move(handler.stack.front().v);
+    else
+        return Value();
+}
+
+struct JsonStream::Private
+{
+    // what the tokenizer accepts next, one entry per open container
+    enum Expect : char
+    {
+        TopValue,
+        ObjectKeyOrEnd,
+        ObjectKey,
+        ObjectColon,
+        ObjectValue,
+        ObjectCommaOrEnd,
+        ArrayValueOrEnd,
+        ArrayValue,
+        ArrayCommaOrEnd,
+    };
+
+    // scalar token split by a chunk boundary
+    enum Token : char
+    {
+        NoToken,
+        StringToken,
+        KeyToken,
+        NumberToken,
+        LiteralToken,
+    };
+
+    size_t maxDepth;
+    size_t maxSize;
+    MyHandler handler;
+    std::vector<Expect> stack = { TopValue };
+    Token token = NoToken;
+    bool escape = false;
+    std::string text;
+    // bytes of the current message
+    size_t size = 0;
+    bool failed = false;
+
+    bool feed(char c, std::function<void (Value &&)> const & emit);
+
+    bool startValue()
+    {
+        Expect e = stack.back();
+        return e == TopValue || e == ObjectValue || e == ArrayValueOrEnd || e == ArrayValue;
+    }
+
+    bool push(Expect e)
+    {
+        stack.push_back(e);
+        return stack.size() <= maxDepth + 1;
+    }
+
+    void completed(std::function<void (Value &&)> const & emit)
+    {
+        switch (stack.back()) {
+        case TopValue: {
+            Value v = std::move(handler.stack.front().v);
+            handler.stack.clear();
+            handler.stack.push_back(MyHandler::Layer());
+            size = 0;
+            emit(std::move(v));
+            break;
+        }
+        case ObjectValue: stack.back() = ObjectCommaOrEnd; break;
+        default: stack.back() = ArrayCommaOrEnd; break;
+        }
+    }
+
+    bool endString();
+
+    bool endNumber();
+
+    bool endLiteral();
+};
+
+static void appendUtf8(std::string & s, unsigned u)
+{
+    if (u < 0x80) {
+        s.push_back(static_cast<char>(u));
+    } else if (u < 0x800) {
+        s.push_back(static_cast<char>(0xC0 | (u >> 6)));
+        s.push_back(static_cast<char>(0x80 | (u & 0x3F)));
+    } else if (u < 0x10000) {
+        s.push_back(static_cast<char>(0xE0 | (u >> 12)));
+        s.push_back(static_cast<char>(0x80 | ((u >> 6) & 0x3F)));
+        s.push_back(static_cast<char>(0x80 | (u & 0x3F)));
+    } else {
+        s.push_back(static_cast<char>(0xF0 | (u >> 18)));
+        s.push_back(static_cast<char>(0x80 | ((u >> 12) & 0x3F)));
+        s.push_back(static_cast<char>(0x80 | ((u >> 6) & 0x3F)));
+        s.push_back(static_cast<char>(0x80 | (u & 0x3F)));
+    }
+}
+
+static bool unescape(std::string_view in, std::string & out)
+{
+    out.reserve(in.size());
+    for (size_t i = 0; i < in.size(); ++i) {
+        char c = in[i];
+        if (c != '\\') {
+            out.push_back(c);
+            continue;
+        }
+        if (++i == in.size())
+            return false;
+        switch (in[i]) {
+        case '"': out.push_back('"'); break;
+        case '\\': out.push_back('\\'); break;
+        case '/': out.push_back('/'); break;
+        case 'b': out.push_back('\b'); break;
+        case 'f': out.push_back('\f'); break;
+        case 'n': out.push_back('\n'); break;
+        case 'r': out.push_back('\r'); break;
+        case 't': out.push_back('\t'); break;
+        case 'u': {
+            unsigned u = 0;
+            auto hex = [&in, &i](unsigned & v) {
+                if (i + 4 >= in.size())
+                    return false;
+                auto r = std::from_chars(in.data() + i + 1, in.data() + i + 5, v, 16);
+                i += 4;
+                return r.ec == std::errc() && r.ptr == in.data() + i + 1;
+            };
+            if (!hex(u))
+                return false;
+            // lone low surrogate
+            if (u >= 0xDC00 && u < 0xE000)
+                return false;
+            // surrogate pair
+            if (u >= 0xD800 && u < 0xDC00) {
+                unsigned l = 0;
+                if (i + 2 >= in.size() || in[i + 1] != '\\' || in[i + 2] != 'u')
+                    return false;
+                i += 2;
+                if (!hex(l) || l < 0xDC00 || l >= 0xE000)
+                    return false;
+                u = 0x10000 + ((u - 0xD800) << 10) + (l - 0xDC00);
+            }
+            appendUtf8(out, u);
+            break;
+        }
+        default: return false;
+        }
+    }
+    return true;
+}
+
+bool JsonStream::Private::endString()
+{
+    std::string s;
+    if (!unescape(text, s))
+        return false;
+    SizeType n = static_cast<SizeType>(s.size());
+    if (token == KeyToken) {
+        stack.back() = ObjectColon;
+        return handler.Key(s.c_str(), n, true);
+    }
+    return handler.String(s.c_str(), n, true);
+}
+
+bool JsonStream::Private::endNumber()
+{
+    char const * b = text.c_str();
+    char const * e = b + text.size();
+    if (text.find_first_of(".eE") == std::string::npos) {
+        long long n = 0;
+        auto r = std::from_chars(b, e, n);
+        if (r.ec == std::errc() && r.ptr == e) {
+            if (n >= INT_MIN && n <= INT_MAX)
+                return handler.Int(static_cast<int>(n));
+            return handler.Int64(n);
+        }
+        // out of range integers become doubles, like in rapidjson
+    }
+    char * end = nullptr;
+    double d = strtod(b, &end);
+    return end == e && handler.Double(d);
+}
+
+bool JsonStream::Private::endLiteral()
+{
+    if (text == "true")
+        return handler.Bool(true);
+    if (text == "false")
+        return handler.Bool(false);
+    if (text == "null")
+        return handler.Null();
+    return false;
+}
+
+bool JsonStream::Private::feed(char c, std::function<void (Value &&)> const & emit)
+{
+    if (token == StringToken || token == KeyToken) {
+        // control characters must be escaped
+        if (static_cast<unsigned char>(c) < 0x20)
+            return false;
+        if (escape) {
+            escape = false;
+        } else if (c == '\\') {
+            escape = true;
+        } else if (c == '"') {
+            bool ok = endString();
+            token = NoToken;
+            text.clear();
+            if (ok && stack.back() != ObjectColon)
+                completed(emit);
+            return ok;
+        }
+        text.push_back(c);
+        return true;
+    }
+    if (token == NumberToken || token == LiteralToken) {
+        bool more = token == NumberToken
+                ? (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'
+                : c >= 'a' && c <= 'z';
+        if (more) {
+            text.push_back(c);
+            return true;
+        }
+        bool ok = token == NumberToken ? endNumber() : endLiteral();
+        token = NoToken;
+        text.clear();
+        if (!ok)
+            return false;
+        completed(emit);
+        // fall through, c is the next token
+    }
+    switch (c) {
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+        if (stack.size() == 1)
+            size = 0;
+        return true;
+    case '{':
+        return startValue() && push(ObjectKeyOrEnd) && handler.StartObject();
+    case '[':
+        return startValue() && push(ArrayValueOrEnd) && handler.StartArray();
+    case '}':
+        if (stack.back() != ObjectKeyOrEnd && stack.back() != ObjectCommaOrEnd)
+            return false;
+        stack.pop_back();
+        if (!handler.EndObject(0))
+            return false;
+        completed(emit);
+        return true;
+    case ']':
+        if (stack.back() != ArrayValueOrEnd && stack.back() != ArrayCommaOrEnd)
+            return false;
+        stack.pop_back();
+        if (!handler.EndArray(0))
+            return false;
+        completed(emit);
+        return true;
+    case ',':
+        if (stack.back() == ObjectCommaOrEnd)
+            stack.back() = ObjectKey;
+        else if (stack.back() == ArrayCommaOrEnd)
+            stack.back() = ArrayValue;
+        else
+            return false;
+        return true;
+    case ':':
+        if (stack.back() != ObjectColon)
+            return false;
+        stack.back() = ObjectValue;
+        return true;
+    case '"':
+        if (stack.back() == ObjectKeyOrEnd || stack.back() == ObjectKey)
+            token = KeyToken;
+        else if (startValue())
+            token = StringToken;
+        else
+            return false;
+        return true;
+    default:
+        if (!startValue())
+            return false;
+        if ((c >= '0' && c <= '9') || c == '-')
+            token = NumberToken;
+        else if (c >= 'a' && c <= 'z')
+            token = LiteralToken;
+        else
+            return false;
+        text.push_back(c);
+        return true;
+    }
+}
+
+JsonStream::JsonStream(size_t maxDepth, size_t maxSize)
+    : d_(new Private)
+{
+    d_->maxDepth = maxDepth;
+    d_->maxSize = maxSize;
+}
+
+JsonStream::~JsonStream()
+{
+    delete d_;
+}
+
+bool JsonStream::feed(const char *data, size_t size, const std::function<void (Value &&)> &emit)
+{
+    if (d_->failed)
+        return false;
+    std::vector<Value> values;
+    {
+        // values completed in this chunk are allocated together, partial values
+        //   may span the arenas of several chunks. They are emitted after the
+        //   scope, what the receivers allocate does not go to the arena.
+        Arena::Scope scope;
+        std::function<void (Value &&)> collect = [&values](Value && v) {
+            values.emplace_back(std::move(v));
+        };
+        for (size_t i = 0; i < size; ++i) {
+            if (d_->token == Private::StringToken || d_->token == Private::KeyToken) {
+                // copy runs of plain characters in one step
+                size_t j = i;
+                if (!d_->escape) {
+                    while (j < size && data[j] != '"' && data[j] != '\\'
+                           && static_cast<unsigned char>(data[j]) >= 0x20)
+                        ++j;
+                }
+                d_->text.append(data + i, j - i);
+                d_->size += j - i;
+                i = j;
+                if (i == size)
+                    break;
+            }
+            if (++d_->size > d_->maxSize || !d_->feed(data[i], collect)) {
+                d_->failed = true;
+                break;
+            }
+        }
+        if (d_->size > d_->maxSize)
+            d_->failed = true;
+    }
+    for (Value & v : values)
+        emit(std::move(v));
+    return !d_->failed;
+}
+
+bool JsonStream::failed() const
+{
+    return d_->failed;
+}
+
+void JsonStream::reset()
+{
+    size_t maxDepth = d_->maxDepth;
+    size_t maxSize = d_->maxSize;
+    delete d_;
+    d_ = new Private;
+    d_->maxDepth = maxDepth;
+    d_->maxSize = maxSize;
+}
+
+Value Value::fromJsonLazy(std::string &&json)
+{
+    return fromJsonLazy(std::move(json), Array());
+}
+
+Value Value::fromJsonLazy(std::string &&json, Array &&blobs)
+{
+    Arena::Scope scope;
+    // raw members reference the buffer, so the top level is not parsed
+    //   in-situ, the members are when decoded
+    char const * buffer = Arena::keep(std::move(json))->c_str();
+    LazyHandler handler(buffer, blobs.empty() ? nullptr : Arena::keep(std::move(blobs)));
+    Reader reader;
+    StringStream ss(buffer);
+    handler.ss = &ss;
+    if (reader.Parse(ss, handler))
+        return std::move(handler.stack.front().v);
+    else
+        return Value();
+}
+
 std::string Value::toJson(const Value &value)
 {
-    StringBuffer sb;
-    Writer<StringBuffer> writer(sb);
-    writeValue(writer, value);
-    return sb.GetString();
+    std::string json;
+    writeJson(value, json);
+    return json;
 }
 
+std::string Value::toJson(const Value &value, Array &blobs)
+{
+    std::string json;
+    writeJson(value, json, &blobs);
+    return json;
+}
+
+void Value::writeJson(const Value &value, std::string &out, Array *blobs)
+{
+    StringOutput os{out};
+    JsonWriter writer(os);
+    writeValue(writer, value, blobs);
+}
 
 std::ostream &std::operator <<(std::ostream & os, const Value & v)
 {
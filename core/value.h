@@ -2,14 +2,21 @@
 #define VALUE_H
 
 #include "Hybridge_global.h"
+#include "arena.h"
+#include "key.h"
+#include "flatmap.h"
+#include "bytes.h"
 
 #pragma warning( disable: 4251)
 
+#include <cmath>
+#include <limits>
 #include <string>
-#include <map>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <type_traits>
+#include <new>
 
 #include <assert.h>
 
@@ -21,8 +28,18 @@ typedef void Object;
     x(x const & o) = delete; \
     x & operator=(x const & o) = delete;
 
-typedef std::map<std::string, Value> Map;
-typedef std::vector<Value> Array;
+typedef FlatMap<Key, Value, ArenaAllocator<std::pair<Key, Value>>> Map;
+typedef std::vector<Value, ArenaAllocator<Value>> Array;
+
+// Packed numeric arrays, elements stored contiguously without boxing
+typedef std::vector<int, ArenaAllocator<int>> IntArray;
+typedef std::vector<long long, ArenaAllocator<long long>> LongArray;
+typedef std::vector<float, ArenaAllocator<float>> FloatArray;
+typedef std::vector<double, ArenaAllocator<double>> DoubleArray;
+
+// Map keyed by indices (of properties, signals), written as a JSON object
+//  with decimal keys but with integer keys in the binary encoding
+typedef FlatMap<int, Value, ArenaAllocator<std::pair<int, Value>>> IntMap;
 
 class HYBRIDGE_EXPORT Value
 {
@@ -39,26 +56,63 @@ public:
         Array_,
         Map_,
         Object_,
+        Bytes_,
+        IntArray_,
+        LongArray_,
+        FloatArray_,
+        DoubleArray_,
+        IntMap_,
     };
 
 public:
-    Value() : v_(nullptr), t_(None), r_(CRef) {}
+    Value() : t_(None), r_(CRef) { u_.p = nullptr; }
 
     Value(Value && o) : Value() { swap(*this, o); }
 
-    Value(Type t, void * v) : v_(v), t_(t), r_(Ref) {}
+    Value(Type t, void * v) : t_(t), r_(Ref) { u_.p = v; }
 
-    Value(Type t, void const * v) : v_(const_cast<void*>(v)), t_(t), r_(CRef) {}
+    Value(Type t, void const * v) : t_(t), r_(CRef) { u_.p = const_cast<void*>(v); }
 
     Value& operator=(Value && o) { swap(*this, o); return *this; }
 
-    ~Value() { if (r_ == Val) destroys[t_](v_); }
+    ~Value() { if (r_ == Val) destroy(); else if (r_ > CRef) release(); }
 
     DELETE_COPY(Value)
 
-    Value ref() const { Value v; v.v_ = v_; v.t_ = t_; v.r_ = r_ == CRef ? CRef : Ref; return v; }
+    Value ref() const;
+
+    static Value adopt(Type t, void * v);
+
+    // Deep copy
+    Value clone() const;
+
+    // Copy, sharing again what is shared already, raw JSON is not decoded
+    Value copy() const;
+
+    // Deep copy on the heap, not keeping the arena and buffer of a parsed
+    //  message alive. For values kept long after their message.
+    Value persist() const;
 
-    static Value adopt(Type t, void * v) { Value vl(t, v); vl.r_ = Val; return vl; }
+    /*
+     * Move the owned content into a reference counted immutable node, and
+     *  return another handle of it. Handles are shared in O(1), they copy on
+     *  write only when mutated while still shared. Inline scalars and
+     *  references are simply referenced.
+     */
+    Value share();
+
+    bool isShared() const { return r_ == Share; }
+
+    /*
+     * Deep comparison, types must match exactly (an Int never equals a Long).
+     *  Maps compare regardless of the order of entries.
+     */
+    friend HYBRIDGE_EXPORT bool operator==(Value const & l, Value const & r);
+
+    friend bool operator!=(Value const & l, Value const & r) { return !(l == r); }
+
+    // Structural hash, consistent with operator==
+    size_t hash() const;
 
 public:
     Value(bool b) : Value(std::move(b), 0) {}
@@ -84,21 +138,24 @@ public:
     Value(std::string && s) : Value(std::move(s), 0) {}
     Value(char const * s) : Value(std::string(s), 0) {}
     Value(std::string const & s) : Value(std::string(s), 0) {}
+    Value(Key const & k);
     bool isString() const { return t_ == String; }
     std::string & toString(std::string & dft) const { return unref(dft); }
     std::string const & toString(std::string const &dft = std::string()) const { return unref(dft); }
+    // Read a string without materializing values parsed in-situ
+    std::string_view toStringView(std::string_view dft = std::string_view()) const;
 
     Value(Array && a) : Value(std::move(a), 0) {}
     Value(Array & m) : Value(m, 0) {}
     Value(Array const & m) : Value(m, 0) {}
-    bool isArray() const { return t_ == Array_; }
+    bool isArray() const { return type() == Array_; }
     Array & toArray(Array & dft) const { return unref(dft); }
     Array const & toArray(Array const & dft = dftArray) const { return unref(dft); }
 
     Value(Map && m) : Value(std::move(m), 0) {}
     Value(Map & m) : Value(m, 0) {}
     Value(Map const & m) : Value(m, 0) {}
-    bool isMap() const { return t_ == Map_; }
+    bool isMap() const { return type() == Map_; }
     Map & toMap(Map & dft) const { return unref(dft); }
     Map const & toMap(Map const & dft = dftMap) const { return unref(dft); }
 
@@ -106,29 +163,213 @@ public:
     bool isObject() const { return t_ == Object_; }
     Object * toObject() const { return unref(static_cast<Object *>(nullptr)); }
 
+    Value(Bytes && b) : Value(std::move(b), 0) {}
+    Value(Bytes & b) : Value(b, 0) {}
+    Value(Bytes const & b) : Value(b, 0) {}
+    bool isBytes() const { return type() == Bytes_; }
+    Bytes & toBytes(Bytes & dft) const { return unref(dft); }
+    Bytes const & toBytes(Bytes const & dft = dftBytes) const { return unref(dft); }
+
+    /*
+     * Packed arrays hold numbers without per element Values. The mutable
+     *  toArray(Array &) expands them in place into a plain Array, so consumers
+     *  not aware of packed arrays keep working, at the cost of the expansion.
+     *  They are no Array for the const toArray(), which leaves shared and
+     *  const values alone, convert(Array_) gives an expanded copy.
+     */
+    Value(IntArray && a) : Value(std::move(a), 0) {}
+    Value(IntArray & a) : Value(a, 0) {}
+    Value(IntArray const & a) : Value(a, 0) {}
+    bool isIntArray() const { return type() == IntArray_; }
+    IntArray & toIntArray(IntArray & dft) const { return unref(dft); }
+    IntArray const & toIntArray(IntArray const & dft = dftIntArray) const { return unref(dft); }
+
+    Value(LongArray && a) : Value(std::move(a), 0) {}
+    Value(LongArray & a) : Value(a, 0) {}
+    Value(LongArray const & a) : Value(a, 0) {}
+    bool isLongArray() const { return type() == LongArray_; }
+    LongArray & toLongArray(LongArray & dft) const { return unref(dft); }
+    LongArray const & toLongArray(LongArray const & dft = dftLongArray) const { return unref(dft); }
+
+    Value(FloatArray && a) : Value(std::move(a), 0) {}
+    Value(FloatArray & a) : Value(a, 0) {}
+    Value(FloatArray const & a) : Value(a, 0) {}
+    bool isFloatArray() const { return type() == FloatArray_; }
+    FloatArray & toFloatArray(FloatArray & dft) const { return unref(dft); }
+    FloatArray const & toFloatArray(FloatArray const & dft = dftFloatArray) const { return unref(dft); }
+
+    Value(DoubleArray && a) : Value(std::move(a), 0) {}
+    Value(DoubleArray & a) : Value(a, 0) {}
+    Value(DoubleArray const & a) : Value(a, 0) {}
+    bool isDoubleArray() const { return type() == DoubleArray_; }
+    DoubleArray & toDoubleArray(DoubleArray & dft) const { return unref(dft); }
+    DoubleArray const & toDoubleArray(DoubleArray const & dft = dftDoubleArray) const { return unref(dft); }
+
+    bool isPackedArray() const { return isPacked(type()); }
+
+    /*
+     * Maps with string keys holding decimal numbers (as parsed from JSON)
+     *  convert to IntMap, and back.
+     */
+    Value(IntMap && m) : Value(std::move(m), 0) {}
+    Value(IntMap & m) : Value(m, 0) {}
+    Value(IntMap const & m) : Value(m, 0) {}
+    bool isIntMap() const { return type() == IntMap_; }
+    IntMap & toIntMap(IntMap & dft) const { return unref(dft); }
+    IntMap const & toIntMap(IntMap const & dft = dftIntMap) const { return unref(dft); }
+
     static Map const dftMap;
     static Array const dftArray;
+    static Bytes const dftBytes;
+    static IntArray const dftIntArray;
+    static LongArray const dftLongArray;
+    static FloatArray const dftFloatArray;
+    static DoubleArray const dftDoubleArray;
+    static IntMap const dftIntMap;
 
     static Value fromJson(std::string const & json);
+    // Parse in-situ, strings of the result reference slices of @p json
+    static Value fromJson(std::string && json);
     static std::string toJson(Value const & value);
 
+    /*
+     * Bytes values are encoded inline as {"__Bytes__": "<base64>"} by default.
+     *  With a side channel, they are written as {"__Bytes__": <index>} instead
+     *  and referenced (not copied) into @p blobs, to be transfered separately.
+     */
+    static std::string toJson(Value const & value, Array & blobs);
+    // Parse in-situ, taking Bytes values for side channel indices from @p blobs
+    static Value fromJson(std::string && json, Array && blobs);
+
+    /*
+     * Parse the top level of @p json only, objects and arrays in the top level
+     *  object or array (of a compact message) are kept as raw JSON and decoded
+     *  on first access. Members never accessed cost
+     *  no allocation, and are written back verbatim.
+     */
+    static Value fromJsonLazy(std::string && json);
+    // Parse lazily, taking Bytes values for side channel indices from @p blobs
+    static Value fromJsonLazy(std::string && json, Array && blobs);
+
+    // Unparsed JSON of a lazily parsed value, empty once decoded
+    std::string_view rawJson() const;
+
+    /*
+     * Append the JSON encoding of @p value to @p out, without intermediate
+     *  strings. Callers keep @p out around (clearing it) to reuse its capacity.
+     */
+    static void writeJson(Value const & value, std::string & out, Array * blobs = nullptr);
+
+    /*
+     * Compact binary encoding (MessagePack), for native peers. Unlike JSON it
+     *  keeps Float, Bytes and packed array types. Appends to @p out.
+     */
+    static void writeBinary(Value const & value, std::string & out);
+    // Decode in-situ, strings of the result reference slices of @p data
+    static Value fromBinary(std::string && data);
+    // Whether a message in @p data is binary encoded (rather than JSON)
+    static bool isBinary(std::string_view data);
+
+    // Lazily parsed values are decoded to get their exact type
     Type type() const
     {
+        if (r_ == Raw)
+            decode();
         return t_;
     }
 
-    void * value() { return v_; }
+    // Whether this value can be converted to @p type, scalars and strings
+    //  convert among each other
+    bool canConvert(Type type) const;
 
-    void const * value() const { return v_; }
+    // Convert to a value of @p type, or None if not convertible. Elements of
+    //  containers are copied, or moved out of an expiring value.
+    Value convert(Type type) const &;
+
+    Value convert(Type type) &&;
+
+    /*
+     * Call @p f with the content as its exact type, std::nullptr_t for None
+     *  and std::string_view for strings (not materializing in-situ strings).
+     *  All overloads of @p f must return the same type.
+     */
+    template<typename F>
+    decltype(auto) visit(F && f) const
+    {
+        switch (type()) {
+        case Bool: return f(*static_cast<bool const *>(ptr()));
+        case Int: return f(*static_cast<int const *>(ptr()));
+        case Long: return f(*static_cast<long long const *>(ptr()));
+        case Float: return f(*static_cast<float const *>(ptr()));
+        case Double: return f(*static_cast<double const *>(ptr()));
+        case String: return f(toStringView());
+        case Array_: return f(*static_cast<Array const *>(ptr()));
+        case Map_: return f(*static_cast<Map const *>(ptr()));
+        case Object_: return f(*static_cast<Object * const *>(ptr()));
+        case Bytes_: return f(*static_cast<Bytes const *>(ptr()));
+        case IntArray_: return f(*static_cast<IntArray const *>(ptr()));
+        case LongArray_: return f(*static_cast<LongArray const *>(ptr()));
+        case FloatArray_: return f(*static_cast<FloatArray const *>(ptr()));
+        case DoubleArray_: return f(*static_cast<DoubleArray const *>(ptr()));
+        case IntMap_: return f(*static_cast<IntMap const *>(ptr()));
+        default: return f(nullptr);
+        }
+    }
+
+    void * value() { return ptr(); }
+
+    void const * value() const { return ptr(); }
 
 private:
     enum Refr
     {
         Val, // Own a value instanse, delete on destory
         Ref, // Own a mutable outer instanse
-        CRef // Own a const outer instanse
+        CRef, // Own a const outer instanse
+        View, // Own a slice of a buffer kept by an arena, materialize on demand
+        Share, // Own a reference of a shared immutable node, copy on write
+        Raw, // Own a slice of unparsed JSON kept by an arena, decode on access
     };
 
+    struct SharedNode;
+
+    struct Slice
+    {
+        char const * data;
+        size_t size;
+        std::string * str;
+        // Bytes transfered in a side channel, of raw JSON
+        Array * blobs;
+        // Raw JSON copied, it is not decoded in-situ
+        bool copied;
+    };
+
+    friend struct MyHandler;
+    friend struct LazyHandler;
+    friend struct BinaryReader;
+
+    static Value view(char const * data, size_t size);
+
+    static Value raw(char const * data, size_t size, Type type, Array * blobs);
+
+    // Another raw value of the same JSON, in the arena keeping it
+    Value rawCopy() const;
+
+    // Replace raw JSON with the parsed value, in-situ in the arena of the slice
+    void decode() const;
+
+    std::string * materialize() const;
+
+    void * indirect() const;
+
+    void detach() const;
+
+    void release();
+
+    // Replace a packed array with the equivalent plain Array, on this handle
+    //   only, like detach()
+    void unpack() const;
+
     template<typename T>
     struct TypeOf
     {
@@ -144,120 +385,198 @@ private:
     template<> struct TypeOf<Array> { static constexpr Type value = Array_; };
     template<> struct TypeOf<Map> { static constexpr Type value = Map_; };
     template<> struct TypeOf<Object*> { static constexpr Type value = Object_; };
-
+    template<> struct TypeOf<Bytes> { static constexpr Type value = Bytes_; };
+    template<> struct TypeOf<IntArray> { static constexpr Type value = IntArray_; };
+    template<> struct TypeOf<LongArray> { static constexpr Type value = LongArray_; };
+    template<> struct TypeOf<FloatArray> { static constexpr Type value = FloatArray_; };
+    template<> struct TypeOf<DoubleArray> { static constexpr Type value = DoubleArray_; };
+    template<> struct TypeOf<IntMap> { static constexpr Type value = IntMap_; };
+
+    // Scalars (and Object pointers) owned by value are stored inline in the
+    //  union, only strings, arrays and maps live on the heap
     template<typename T>
-    static void destroy(void * v) { delete reinterpret_cast<T*>(v); }
+    struct IsInline
+    {
+        static constexpr bool value = std::is_scalar<T>::value;
+    };
 
-    template<typename T>
-    static void * null_conv(void *) { return new T(); }
+    static constexpr bool isInline(Type t)
+    {
+        return (t >= Bool && t <= Double) || t == Object_;
+    }
+
+    static constexpr bool isPacked(Type t)
+    {
+        return t >= IntArray_ && t <= DoubleArray_;
+    }
 
-    template<typename F, typename T>
-    static void * conv(void * v) { return new T(static_cast<T>(*reinterpret_cast<F*>(v))); }
+    // Free an owned node, a switch over the tag with direct (inlinable) calls
+    void destroy()
+    {
+        switch (t_) {
+        case String: Arena::destroy(static_cast<std::string *>(u_.p)); break;
+        case Array_: Arena::destroy(static_cast<Array *>(u_.p)); break;
+        case Map_: Arena::destroy(static_cast<Map *>(u_.p)); break;
+        case Bytes_: Arena::destroy(static_cast<Bytes *>(u_.p)); break;
+        case IntArray_: Arena::destroy(static_cast<IntArray *>(u_.p)); break;
+        case LongArray_: Arena::destroy(static_cast<LongArray *>(u_.p)); break;
+        case FloatArray_: Arena::destroy(static_cast<FloatArray *>(u_.p)); break;
+        case DoubleArray_: Arena::destroy(static_cast<DoubleArray *>(u_.p)); break;
+        case IntMap_: Arena::destroy(static_cast<IntMap *>(u_.p)); break;
+        default: break; // inline scalars
+        }
+    }
 
-    template<typename F>
-    static void * conv_str(void * v) { return new std::string(std::to_string(*reinterpret_cast<F*>(v))); }
+    // Scalar conversions, computed directly into the result
 
-    static constexpr void (*destroys[])(void *) = { nullptr,
-            destroy<bool>, destroy<int>, destroy<long long>,
-            destroy<float>, destroy<double>, destroy<std::string>,
-            destroy<Array>, destroy<Map>, destroy<Object*>,
-    };
+    // Values out of the range of T (and NaN as an integer) are @p dflt,
+    //   their conversion would be undefined or truncated
+    template<typename T, typename F>
+    static T cast(F f, T dflt)
+    {
+        if constexpr (std::is_same<T, bool>::value) {
+            return f != 0;
+        } else if constexpr (std::is_integral<T>::value && std::is_floating_point<F>::value) {
+            static_assert(std::is_signed<T>::value, "signed integers only");
+            // -min is a power of two, exact as F
+            constexpr F lower = static_cast<F>(std::numeric_limits<T>::min());
+            return f >= lower && f < -lower ? static_cast<T>(f) : dflt;
+        } else if constexpr (std::is_integral<T>::value && sizeof(T) < sizeof(F)) {
+            return f >= std::numeric_limits<T>::min() && f <= std::numeric_limits<T>::max()
+                    ? static_cast<T>(f) : dflt;
+        } else if constexpr (std::is_floating_point<T>::value && sizeof(T) < sizeof(F)) {
+            return std::isfinite(f) && (f < std::numeric_limits<T>::lowest() || f > std::numeric_limits<T>::max())
+                    ? dflt : static_cast<T>(f);
+        } else {
+            return static_cast<T>(f);
+        }
+    }
 
-#define CONVS(c) c<bool>, c<int>, c<long long>, c<float>, c<double>, \
-    c<std::string>, c<Array>, c<Map>, c<Object*>
-#define CONVS2(c, f) c<f, bool>, c<f, int>, c<f, long long>, c<f, float>, c<f, double>, conv_str<f>
-
-    static constexpr void * (*convertors[][10])(void *) = {
-        { nullptr, CONVS(null_conv) },
-        { nullptr, CONVS2(conv, bool) },
-        { nullptr, CONVS2(conv, int) },
-        { nullptr, CONVS2(conv, long long) },
-        { nullptr, CONVS2(conv, float) },
-        { nullptr, CONVS2(conv, double) },
-        { nullptr },
-        { nullptr },
-        { nullptr },
-        { nullptr },
-    };
+    // Only whole strings are numbers, "12abc" is @p dflt
+    template<typename T>
+    static T parse(std::string_view s, T dflt)
+    {
+        if constexpr (std::is_same<T, bool>::value) {
+            return s == "true" || (s != "false" && parseLong(s, dflt) != 0);
+        } else if constexpr (std::is_integral<T>::value) {
+            return cast<T>(parseLong(s, dflt), dflt);
+        } else {
+            return cast<T>(parseDouble(s, dflt), dflt);
+        }
+    }
+
+    static long long parseLong(std::string_view s, long long dflt);
+
+    static double parseDouble(std::string_view s, double dflt);
+
+    template<typename T>
+    T value(T dflt) const
+    {
+        switch (t_) {
+        case None: return T(); // not dflt, kept for compatibility
+        case Bool: return cast<T>(*reinterpret_cast<bool const *>(ptr()), dflt);
+        case Int: return cast<T>(*reinterpret_cast<int const *>(ptr()), dflt);
+        case Long: return cast<T>(*reinterpret_cast<long long const *>(ptr()), dflt);
+        case Float: return cast<T>(*reinterpret_cast<float const *>(ptr()), dflt);
+        case Double: return cast<T>(*reinterpret_cast<double const *>(ptr()), dflt);
+        case String: return parse<T>(toStringView(), dflt);
+        default: return dflt;
+        }
+    }
 
     template<typename T>
     Value(T && t, int)
-        : v_(new T(std::move(t)))
-        , t_(TypeOf<T>::value)
+        : t_(TypeOf<T>::value)
         , r_(Val)
     {
+        if constexpr (IsInline<T>::value)
+            new (&u_) T(std::move(t));
+        else
+            u_.p = Arena::create<T>(std::move(t));
     }
 
     template<typename T>
     Value(T & t, int)
-        : v_(&t)
-        , t_(TypeOf<T>::value)
+        : t_(TypeOf<T>::value)
         , r_(Ref)
     {
+        u_.p = &t;
     }
 
     template<typename T>
     Value(T const & t, int)
-        : v_(const_cast<T *>(&t))
-        , t_(TypeOf<T>::value)
+        : t_(TypeOf<T>::value)
         , r_(CRef)
     {
+        u_.p = const_cast<T *>(&t);
+    }
+
+    void * ptr() const
+    {
+        if (r_ > CRef)
+            return indirect();
+        return r_ == Val && isInline(t_) ? const_cast<Storage *>(&u_) : u_.p;
     }
 
     template<typename T>
     T & unref(T & dflt) const
     {
+        if (r_ == Raw)
+            decode();
+        if constexpr (std::is_same<T, Array>::value) {
+            if (isPacked(t_))
+                unpack();
+        }
         if (t_ != TypeOf<T>::value)
             return dflt;
         assert(r_ != CRef);
-        return *reinterpret_cast<T*>(v_);
+        if (r_ == Share)
+            detach();
+        return *reinterpret_cast<T*>(ptr());
     }
 
     template<typename T>
     T const & unref(T const & dflt) const
     {
+        if (r_ == Raw)
+            decode();
         if (t_ != TypeOf<T>::value)
             return dflt;
-        return *reinterpret_cast<T*>(v_);
-    }
-
-    template<typename T>
-    T value(T dflt) const
-    {
-        if (t_ == TypeOf<T>::value)
-            return *reinterpret_cast<T*>(v_);
-        auto conv = convertors[t_][TypeOf<T>::value];
-        if (conv) {
-            T * t = reinterpret_cast<T*>(conv(v_));
-            T tt = *t;
-            delete t;
-            return tt;
-        }
-        return dflt;
+        return *reinterpret_cast<T*>(ptr());
     }
 
     friend void swap(Value & l, Value & r)
     {
-        std::swap(l.v_, r.v_);
+        std::swap(l.u_, r.u_);
         std::swap(l.t_, r.t_);
         std::swap(l.r_, r.r_);
     }
 
 private:
-    void * v_;
+    union Storage
+    {
+        void * p;
+        bool b;
+        int i;
+        long long l;
+        float f;
+        double d;
+    };
+
+    Storage u_;
     Type t_;
     Refr r_; // reference type
 };
 
 namespace std {
 
-template <>
-map<std::string, Value>::map(map const & ) = delete;
+ostream & operator <<(ostream &, Value const &);
 
 template <>
-map<std::string, Value> & map<std::string, Value>::operator=(map const & ) = delete;
-
-ostream & operator <<(ostream &, Value const &);
+struct hash<Value>
+{
+    size_t operator()(Value const & v) const { return v.hash(); }
+};
 
 }
 
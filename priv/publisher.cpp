@@ -1,34 +1,105 @@
 #include "publisher.h"
 #include "core/channel.h"
 #include "core/transport.h"
+#include "core/compression.h"
+#include "core/updatescheduler.h"
 #include "core/metaobject.h"
 #include "core/channel.h"
 #include "collection.h"
 #include "core/value.h"
 #include "debug.h"
 
+#include <charconv>
 #include <iostream>
+#include <climits>
+#include <string.h>
 
 namespace {
 
 
-    Message createResponse(Value &&id, Value && data)
+    template<typename M>
+    void createResponse(M &response, Value &&id, Value && data)
     {
-        Message response;
-        response[KEY_TYPE] = TypeResponse;
-        response[KEY_ID] = std::move(id);
-        response[KEY_DATA] = std::move(data);
-        return response;
+        initMessage(response, TypeResponse);
+        setMessageField(response, KEY_ID, std::move(id));
+        setMessageField(response, KEY_DATA, std::move(data));
     }
 
-    /// TODO: what is the proper value here?
-    const int PROPERTY_UPDATE_INTERVAL = 50;
+    // Pick the data built for the envelope of the message
+    Value & envelopeData(Message const &, Value & data, Value &) { return data; }
+
+    Value & envelopeData(CompactMessage const &, Value &, Value & compact) { return compact; }
+
+    size_t jsonSize(Value const &value);
+
+    // Estimated JSON size of a value, counting strings without escapes
+    struct JsonSize
+    {
+        template<typename N>
+        static size_t number(N n)
+        {
+            char buf[32];
+            return static_cast<size_t>(std::to_chars(buf, buf + sizeof(buf), n).ptr - buf);
+        }
+
+        template<typename P>
+        static size_t packed(P const &a)
+        {
+            size_t size = a.size() + 1;
+            for (auto n : a)
+                size += number(n);
+            return size;
+        }
+
+        size_t operator()(std::nullptr_t) const { return 4; }
+        size_t operator()(bool b) const { return b ? 4 : 5; }
+        size_t operator()(int n) const { return number(n); }
+        size_t operator()(long long n) const { return number(n); }
+        size_t operator()(float n) const { return number(n); }
+        size_t operator()(double n) const { return number(n); }
+        size_t operator()(std::string_view s) const { return s.size() + 2; }
+        size_t operator()(Object *) const { return 4; }
+        size_t operator()(Bytes const &b) const { return (b.size() + 2) / 3 * 4 + KEY_Bytes.size() + 7; }
+        size_t operator()(IntArray const &a) const { return packed(a); }
+        size_t operator()(LongArray const &a) const { return packed(a); }
+        size_t operator()(FloatArray const &a) const { return packed(a); }
+        size_t operator()(DoubleArray const &a) const { return packed(a); }
+
+        size_t operator()(Array const &a) const
+        {
+            size_t size = a.size() + 1;
+            for (Value const &v : a)
+                size += jsonSize(v);
+            return size;
+        }
+
+        size_t operator()(Map const &m) const
+        {
+            size_t size = m.size() + 1;
+            for (auto const &e : m)
+                size += e.first.size() + 3 + jsonSize(e.second);
+            return size;
+        }
+
+        size_t operator()(IntMap const &m) const
+        {
+            size_t size = m.size() + 1;
+            for (auto const &e : m)
+                size += number(e.first) + 3 + jsonSize(e.second);
+            return size;
+        }
+    };
+
+    size_t jsonSize(Value const &value)
+    {
+        std::string_view raw = value.rawJson();
+        return raw.empty() ? value.visit(JsonSize()) : raw.size();
+    }
 }
 
 Publisher::Publisher(Channel * bridge)
     : channel_(bridge)
     , signalHandler_(this)
-    , clientIsIdle_(false)
     , blockUpdates_(false)
     , propertyUpdatesInitialized_(false)
 {
@@ -42,6 +113,8 @@ void Publisher::registerObject(std::string const &id, Object *object)
 {
     registeredObjects_[id] = object;
     objectIds_[object] = id;
+    if (initSnapshot_.type() != Value::None)
+        initSnapshotStale_.insert(object);
     if (propertyUpdatesInitialized_) {
         if (!channel_->transports_.empty()) {
             warning("Registered new object after initialization, existing clients won't be notified!");
@@ -59,20 +132,51 @@ Map Publisher::classInfoForObject(const Object *object, Transport *transport)
         return data;
     }
 
+    const MetaObject *metaObject = channel_->metaObject(object);
+    ClassInfo &info = classInfo(metaObject);
+    if (objectMetas_.emplace(object, metaObject).second)
+        ++info.objects;
+    Array properties;
+    properties.reserve(info.properties.size());
+    for (ClassInfo::Property &prop : info.properties) {
+        Array propertyInfo;
+        propertyInfo.reserve(4);
+        propertyInfo.emplace_back(static_cast<int>(prop.property->propertyIndex()));
+        propertyInfo.emplace_back(prop.name);
+        propertyInfo.emplace_back(prop.signalInfo.share());
+        propertyInfo.emplace_back(wrapResult(prop.property->read(object), transport));
+        std::cout << "property: " << prop.name.str() << " = " << propertyInfo.back() << std::endl;
+        properties.emplace_back(std::move(propertyInfo));
+    }
+    // the client got values newer than the ones last sent, which the next
+    // updates must not be compared to
+    sentPropertyValues_.erase(object);
+    data[KEY_CLASS] = info.className;
+    data[KEY_SIGNALS] = info.signals.share();
+    data[KEY_METHODS] = info.methods.share();
+    data[KEY_PROPERTIES] = std::move(properties);
+    if (info.enums.type() != Value::None) {
+        data[KEY_ENUMS] = info.enums.share();
+    }
+    return data;
+}
+
+Publisher::ClassInfo &Publisher::classInfo(const MetaObject *metaObject)
+{
+    auto it = classInfos_.find(metaObject);
+    if (it != classInfos_.end())
+        return it->second;
+
+    ClassInfo &info = classInfos_[metaObject];
     Array signals;
     Array methods;
-    Array properties;
     Map qtEnums;
 
-    const MetaObject *metaObject = channel_->metaObject(object);
     std::set<size_t> notifySignals;
     std::set<std::string > identifiers;
     for (size_t i = 0; i < metaObject->propertyCount(); ++i) {
         const MetaProperty &prop = metaObject->property(i);
-        Array propertyInfo;
-        const std::string &propertyName = prop.name();
-        propertyInfo.emplace_back(static_cast<int>(prop.propertyIndex()));
-        propertyInfo.emplace_back(propertyName);
+        const Key propertyName = Key::intern(prop.name());
         identifiers.emplace(propertyName);
         Array signalInfo;
         if (prop.hasNotifySignal()) {
@@ -80,22 +184,20 @@ Map Publisher::classInfoForObject(const Object *object, Transport *transport)
             // optimize: compress the common propertyChanged notification names, just send a 1
             const std::string  &notifySignal = prop.notifySignal().name();
             static const std::string  changedSuffix = "Changed";
-            if (notifySignal == propertyName + changedSuffix)
+            if (notifySignal == propertyName.str() + changedSuffix)
             {
                 signalInfo.emplace_back(1);
             } else {
-                signalInfo.emplace_back(notifySignal);
+                signalInfo.emplace_back(Key::intern(notifySignal));
             }
             signalInfo.emplace_back(static_cast<int>(prop.notifySignalIndex()));
         } else if (!prop.isConstant()) {
+            info.unnotified = true;
             warning("Property '%s'' of object '%s' has no notify signal and is not constant, "
                      "value updates in HTML will be broken!",
                      prop.name(), metaObject->className());
         }
-        propertyInfo.emplace_back(std::move(signalInfo));
-        propertyInfo.emplace_back(wrapResult(prop.read(object), transport));
-        std::cout << "property: " << propertyName << " = " << propertyInfo.back() << std::endl;
-        properties.emplace_back(std::move(propertyInfo));
+        info.properties.emplace_back(ClassInfo::Property{&prop, propertyName, std::move(signalInfo)});
     }
     for (size_t i = 0; i < metaObject->methodCount(); ++i) {
         if (contains(notifySignals, i)) {
@@ -103,7 +205,7 @@ Map Publisher::classInfoForObject(const Object *object, Transport *transport)
         }
         const MetaMethod &method = metaObject->method(i);
         //NOTE: this must be a string, otherwise it will be converted to '{}' in QML
-        const std::string &name = method.name();
+        const Key name = Key::intern(method.name());
         // optimize: skip overloaded methods/signals or property getters, on the JS side we can only
         // call one of them anyways
         // TODO: basic support for overloaded signals, methods
@@ -120,7 +222,7 @@ Map Publisher::classInfoForObject(const Object *object, Transport *transport)
         Array paramNames;
         for (size_t j = 0; j < method.parameterCount(); ++j) {
             paramTypes.emplace_back(method.parameterType(j));
-            paramNames.emplace_back(std::string(method.parameterName(j)));
+            paramNames.emplace_back(Key::intern(method.parameterName(j)));
         }
         data.emplace_back(std::move(paramTypes));
         data.emplace_back(std::move(paramNames));
@@ -134,48 +236,139 @@ Map Publisher::classInfoForObject(const Object *object, Transport *transport)
         MetaEnum const & enumerator = metaObject->enumerator(i);
         Map values;
         for (size_t k = 0; k < enumerator.keyCount(); ++k) {
-            values[enumerator.key(k)] = enumerator.value(k);
+            values[Key::intern(enumerator.key(k))] = enumerator.value(k);
         }
-        qtEnums[enumerator.name()] = std::move(values);
+        qtEnums[Key::intern(enumerator.name())] = std::move(values);
     }
-    data[KEY_CLASS] = std::string(metaObject->className());
-    data[KEY_SIGNALS] = std::move(signals);
-    data[KEY_METHODS] = std::move(methods);
-    data[KEY_PROPERTIES] = std::move(properties);
+    info.className = Key::intern(metaObject->className());
+    info.signals = std::move(signals);
+    info.methods = std::move(methods);
     if (!qtEnums.empty()) {
-        data[KEY_ENUMS] = std::move(qtEnums);
+        info.enums = std::move(qtEnums);
     }
-    return data;
+    return info;
 }
 
-void Publisher::setClientIsIdle(bool isIdle)
+void Publisher::grantCredits(Transport *transport, int credits)
 {
-    if (clientIsIdle_ == isIdle) {
+    // unknown transports would never be removed
+    if (credits <= 0 || !contains(channel_->transports_, transport)) {
+        warning("Ignoring invalid credits for property updates:", credits);
         return;
     }
-    clientIsIdle_ = isIdle;
-    if (!isIdle) {
-        channel_->stopTimer();
-    } else {
-        channel_->startTimer(PROPERTY_UPDATE_INTERVAL);
+    ClientState &client = clients_[transport];
+    bool wasReady = client.credits > 0;
+    client.credits = credits > INT_MAX - client.credits ? INT_MAX : client.credits + credits;
+    if (wasReady)
+        return;
+    ++readyClients_;
+    // kept updates were due already
+    if (!client.pendingPropertyUpdates.empty() || !client.pendingPropertyUpdates2.empty()) {
+        startUpdateTimer(std::chrono::steady_clock::now());
+        return;
     }
+    auto due = std::chrono::steady_clock::time_point::max();
+    for (auto & it : pendingTimes_)
+        due = std::min(due, it.second.due);
+    if (!pendingTimes_.empty())
+        startUpdateTimer(due);
 }
 
-Map Publisher::initializeClient(Transport *transport)
+void Publisher::consumeCredit(Transport *transport)
 {
-    Map objectInfos;
-    {
-        const std::unordered_map<std::string, Object *>::const_iterator end = registeredObjects_.cend();
-        for (std::unordered_map<std::string, Object *>::const_iterator it = registeredObjects_.cbegin(); it != end; ++it) {
-            Map && info = classInfoForObject(it->second, transport);
-            if (!propertyUpdatesInitialized_) {
-                initializePropertyUpdates(it->second, info);
+    auto client = clients_.find(transport);
+    if (client == clients_.end() || client->second.credits <= 0)
+        return;
+    if (--client->second.credits == 0)
+        --readyClients_;
+}
+
+Value Publisher::initializeClient(Transport *transport)
+{
+    if (initSnapshot_.type() == Value::None) {
+        const std::set<std::string> wrapped = wrappedObjectIds(transport);
+        Map objectInfos;
+        {
+            const std::unordered_map<std::string, Object *>::const_iterator end = registeredObjects_.cend();
+            for (std::unordered_map<std::string, Object *>::const_iterator it = registeredObjects_.cbegin(); it != end; ++it) {
+                Map && info = classInfoForObject(it->second, transport);
+                if (!propertyUpdatesInitialized_) {
+                    initializePropertyUpdates(it->second, info);
+                }
+                if (classInfo(channel_->metaObject(it->second)).unnotified)
+                    initSnapshotUnnotified_.insert(it->second);
+                // shared, for updates of the snapshot to copy only the top level
+                objectInfos[it->first] = Value(std::move(info)).share();
+            }
+        }
+        propertyUpdatesInitialized_ = true;
+        initSnapshot_ = std::move(objectInfos);
+        initSnapshotStale_.clear();
+        for (std::string const &id : wrappedObjectIds(transport)) {
+            if (!wrapped.count(id))
+                initSnapshotWrapped_.insert(id);
+        }
+    } else {
+        // give access to the wrapped objects in the snapshot, as wrapResult() does
+        for (std::string const &id : initSnapshotWrapped_) {
+            if (!mapContains(wrappedObjects_, id))
+                continue;
+            if (!contains(mapValue(wrappedObjects_, id).transports, transport))
+                wrappedObjects_[id].transports.emplace_back(transport);
+            if (!mapContains(transportedWrappedObjects_, transport, id))
+                transportedWrappedObjects_.insert(std::make_pair(transport, id));
+        }
+        initSnapshotStale_.insert(initSnapshotUnnotified_.begin(), initSnapshotUnnotified_.end());
+        if (!initSnapshotStale_.empty()) {
+            const std::set<std::string> wrapped = wrappedObjectIds(transport);
+            Map empty;
+            Map &objectInfos = initSnapshot_.toMap(empty);
+            Map &objectJson = initSnapshotJson_.toMap(empty);
+            for (Object const *object : initSnapshotStale_) {
+                const std::string &id = mapValue(objectIds_, object);
+                // wrapped objects are sent with the class information of their first use
+                if (!mapContains(registeredObjects_, id))
+                    continue;
+                Value info(classInfoForObject(object, transport));
+                if (classInfo(channel_->metaObject(object)).unnotified)
+                    initSnapshotUnnotified_.insert(object);
+                objectInfos[id] = info.share();
+                if (initSnapshotJson_.type() != Value::None)
+                    objectJson[id] = info.share();
+            }
+            initSnapshotStale_.clear();
+            for (std::string const &id : wrappedObjectIds(transport)) {
+                if (!wrapped.count(id))
+                    initSnapshotWrapped_.insert(id);
             }
-            objectInfos[it->first] = std::move(info);
         }
     }
-    propertyUpdatesInitialized_ = true;
-    return objectInfos;
+    if (transport->isBinary())
+        return initSnapshot_.share();
+    if (initSnapshotJson_.type() == Value::None) {
+        std::string json;
+        Value::writeJson(initSnapshot_, json);
+        initSnapshotJson_ = Value::fromJsonLazy(std::move(json));
+    }
+    return initSnapshotJson_.share();
+}
+
+std::set<std::string> Publisher::wrappedObjectIds(Transport *transport) const
+{
+    std::set<std::string> ids;
+    auto range = transportedWrappedObjects_.equal_range(transport);
+    for (auto it = range.first; it != range.second; ++it)
+        ids.insert(it->second);
+    return ids;
+}
+
+void Publisher::resetInitSnapshot()
+{
+    initSnapshot_ = Value();
+    initSnapshotJson_ = Value();
+    initSnapshotStale_.clear();
+    initSnapshotUnnotified_.clear();
+    initSnapshotWrapped_.clear();
 }
 
 void Publisher::initializePropertyUpdates(const Object *const object, const Map &objectInfo)
@@ -212,105 +405,316 @@ void Publisher::initializePropertyUpdates(const Object *const object, const Map
 
 void Publisher::sendPendingPropertyUpdates()
 {
-    if (blockUpdates_ || !clientIsIdle_
-            || (pendingPropertyUpdates_.empty() && pendingPropertyUpdates2_.empty())) {
+    if (blockUpdates_) {
+        return;
+    }
+    channel_->stopTimer();
+    timerActive_ = false;
+
+    // take the objects that are due, the others wait for their interval
+    const auto now = std::chrono::steady_clock::now();
+    auto next = std::chrono::steady_clock::time_point::max();
+    auto since = now;
+    PendingPropertyUpdates signalUpdates;
+    PendingPropertyUpdates2 propertyUpdates;
+    for (auto it = pendingTimes_.begin(); it != pendingTimes_.end();) {
+        if (it->second.due > now) {
+            next = std::min(next, it->second.due);
+            ++it;
+            continue;
+        }
+        since = std::min(since, it->second.since);
+        auto sig = pendingPropertyUpdates_.find(it->first);
+        if (sig != pendingPropertyUpdates_.end()) {
+            signalUpdates.emplace(sig->first, std::move(sig->second));
+            pendingPropertyUpdates_.erase(sig);
+        }
+        auto prop = pendingPropertyUpdates2_.find(it->first);
+        if (prop != pendingPropertyUpdates2_.end()) {
+            propertyUpdates.emplace(prop->first, std::move(prop->second));
+            pendingPropertyUpdates2_.erase(prop);
+        }
+        it = pendingTimes_.erase(it);
+    }
+
+    // clients without credits keep the updates for later, clients with kept
+    // updates get them together with the new ones
+    std::vector<Transport*> ready;
+    std::vector<Transport*> kept;
+    bool pending = !signalUpdates.empty() || !propertyUpdates.empty();
+    for (Transport *transport : channel_->transports_) {
+        ClientState &client = clients_[transport];
+        bool hasKept = !client.pendingPropertyUpdates.empty() || !client.pendingPropertyUpdates2.empty();
+        if (client.credits > 0 && !hasKept) {
+            if (pending)
+                ready.emplace_back(transport);
+            continue;
+        }
+        if (pending) {
+            // latest arguments win, property values are read when sent
+            for (auto & it : signalUpdates) {
+                SignalToArgumentsMap &signalArgs = client.pendingPropertyUpdates[it.first];
+                for (auto & sig : it.second)
+                    signalArgs[sig.first] = sig.second.share();
+            }
+            for (auto & it : propertyUpdates)
+                client.pendingPropertyUpdates2[it.first].insert(it.second.begin(), it.second.end());
+        }
+        if (client.credits > 0)
+            kept.emplace_back(transport);
+    }
+
+    size_t values = 0;
+    if (!ready.empty())
+        values += sendPropertyUpdates(signalUpdates, propertyUpdates, ready, true);
+
+    for (Transport *transport : kept) {
+        ClientState &client = clients_[transport];
+        values += sendPropertyUpdates(client.pendingPropertyUpdates, client.pendingPropertyUpdates2, {transport}, false);
+        client.pendingPropertyUpdates.clear();
+        client.pendingPropertyUpdates2.clear();
+    }
+
+    if (values > 0) {
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(now - since);
+        ++updateMetrics_.flushes;
+        updateMetrics_.values += values;
+        updateMetrics_.maxValues = std::max(updateMetrics_.maxValues, values);
+        updateMetrics_.latency += latency;
+        updateMetrics_.maxLatency = std::max(updateMetrics_.maxLatency, latency);
+        scheduler_->flushed(values, latency);
+    }
+
+    if (next != std::chrono::steady_clock::time_point::max())
+        startUpdateTimer(next);
+}
+
+void Publisher::schedule(const Object *object, int interval)
+{
+    const auto now = std::chrono::steady_clock::now();
+    const auto due = now + std::chrono::milliseconds(interval);
+    auto r = pendingTimes_.emplace(object, PendingTime{now, due});
+    if (!r.second) {
+        if (due >= r.first->second.due)
+            return;
+        r.first->second.due = due;
+    }
+    startUpdateTimer(due);
+}
+
+void Publisher::startUpdateTimer(std::chrono::steady_clock::time_point due)
+{
+    if (blockUpdates_ || !readyClients_ || (timerActive_ && timerDue_ <= due)) {
         return;
     }
+    const auto now = std::chrono::steady_clock::now();
+    int msec = 0;
+    if (due > now) {
+        // round up, not to fire before the due time
+        auto wait = std::chrono::duration_cast<std::chrono::microseconds>(due - now);
+        msec = static_cast<int>((wait.count() + 999) / 1000);
+    }
+    timerActive_ = true;
+    timerDue_ = due;
+    channel_->startTimer(msec);
+}
+
+size_t Publisher::sendPropertyUpdates(PendingPropertyUpdates &signalUpdates,
+                                      PendingPropertyUpdates2 const &propertyUpdates,
+                                      std::vector<Transport*> const &transports, bool dropUnchanged)
+{
+    if (signalUpdates.empty() && propertyUpdates.empty()) {
+        return 0;
+    }
+
+    // build the data only in the envelopes in use
+    bool anyMap = false;
+    bool anyCompact = false;
+    for (Transport *transport : transports) {
+        if (transport->isCompact())
+            anyCompact = true;
+        else
+            anyMap = true;
+    }
+
+    struct Updates
+    {
+        Array data;
+        Array compact;
+    };
+    Updates broadcast;
+    std::map<Transport*, Updates> specificUpdates;
+    std::set<Transport*> targets(transports.begin(), transports.end());
+
+    // objects with all properties unchanged are not sent, count what we save
+    size_t dropped = 0;
+    size_t sentSize = 0;
+    bool broadcastDropped = false;
+    std::set<Transport*> specificDropped;
+    auto drop = [this, &dropped, &sentSize](size_t propertyIndex) {
+        ++dropped;
+        ++updateSavings_.values;
+        // "<index>":<value>,
+        updateSavings_.bytes += sentSize + strlen(stringNumber(propertyIndex)) + 4;
+    };
+    auto dropObject = [this, &targets, &broadcastDropped, &specificDropped](std::string const &objectId) {
+        if (mapContains(wrappedObjects_, objectId)) {
+            for (Transport *transport : mapValue(wrappedObjects_, objectId).transports) {
+                if (targets.count(transport))
+                    specificDropped.insert(transport);
+            }
+        } else {
+            broadcastDropped = true;
+        }
+    };
+    // both envelopes share the signal and property maps, the entries are shared
+    // by the messages of all transports and outlive this call in batches
+    size_t values = 0;
+    auto addUpdate = [&](std::string const &objectId, Value &&sigs, Value &&properties) {
+        values += properties.toIntMap().size();
+        Value entry;
+        Value compactEntry;
+        if (anyMap) {
+            Map obj;
+            obj[KEY_OBJECT] = objectId;
+            if (sigs.type() != Value::None)
+                obj[KEY_SIGNALS] = sigs.share();
+            obj[KEY_PROPERTIES] = properties.share();
+            entry = std::move(obj);
+        }
+        if (anyCompact) {
+            Array obj;
+            obj.emplace_back(objectId);
+            obj.emplace_back(std::move(sigs));
+            obj.emplace_back(std::move(properties));
+            compactEntry = std::move(obj);
+        }
 
-    Array data;
-    Array data2;
-    std::map<Transport*, Array> specificUpdates;
+        // if the object is auto registered, just send the update only to clients which know this object
+        if (mapContains(wrappedObjects_, objectId)) {
+            for (Transport *transport : mapValue(wrappedObjects_, objectId).transports) {
+                if (!targets.count(transport))
+                    continue;
+                Updates &updates = specificUpdates[transport];
+                if (transport->isCompact())
+                    updates.compact.emplace_back(compactEntry.share());
+                else
+                    updates.data.emplace_back(entry.share());
+            }
+        } else {
+            if (anyMap)
+                broadcast.data.emplace_back(std::move(entry));
+            if (anyCompact)
+                broadcast.compact.emplace_back(std::move(compactEntry));
+        }
+    };
 
     // convert pending property updates to JSON data
-    const PendingPropertyUpdates::const_iterator end = pendingPropertyUpdates_.cend();
-    for (PendingPropertyUpdates::const_iterator it = pendingPropertyUpdates_.cbegin(); it != end; ++it) {
+    const PendingPropertyUpdates::iterator end = signalUpdates.end();
+    for (PendingPropertyUpdates::iterator it = signalUpdates.begin(); it != end; ++it) {
         const Object *object = it->first;
         const MetaObject *const metaObject = channel_->metaObject(object);
         const std::string objectId = mapValue(objectIds_, object);
         const SignalToPropertyNameMap &objectssignalToPropertyMap_ = mapValue(signalToPropertyMap_, object);
-        // maps property name to current property value
-        Map properties;
+        // maps property index to current property value
+        IntMap properties;
         // maps signal index to list of arguments of the last emit
-        Map sigs;
-        const SignalToArgumentsMap::const_iterator sigEnd = it->second.cend();
-        for (SignalToArgumentsMap::const_iterator sigIt = it->second.cbegin(); sigIt != sigEnd; ++sigIt) {
-            // TODO: can we get rid of the int <-> string conversions here?
+        IntMap sigs;
+        dropped = 0;
+        const SignalToArgumentsMap::iterator sigEnd = it->second.end();
+        for (SignalToArgumentsMap::iterator sigIt = it->second.begin(); sigIt != sigEnd; ++sigIt) {
             for (size_t propertyIndex : mapValue(objectssignalToPropertyMap_, sigIt->first)) {
                 const MetaProperty &property = metaObject->property(propertyIndex);
                 assert(property.isValid());
-                Value && v = wrapResult(property.read(object), nullptr, objectId);
-                properties[stringNumber(propertyIndex)] = std::move(v);
+                Value v = wrapResult(property.read(object), nullptr, objectId);
+                if (dropUnchanged && !propertyValueChanged(object, propertyIndex, v, sentSize)) {
+                    drop(propertyIndex);
+                    continue;
+                }
+                properties[static_cast<int>(propertyIndex)] = std::move(v);
             }
-            sigs[stringNumber(sigIt->first)] = sigIt->second.ref();
+            sigs[static_cast<int>(sigIt->first)] = sigIt->second.share();
         }
-        Map obj;
-        obj[KEY_OBJECT] = objectId;
-        obj[KEY_SIGNALS] = std::move(sigs);
-        obj[KEY_PROPERTIES] = std::move(properties);
-        Value obj2(std::move(obj));
-
-        // if the object is auto registered, just send the update only to clients which know this object
-        if (mapContains(wrappedObjects_, objectId)) {
-            for (Transport *transport : mapValue(wrappedObjects_, objectId).transports) {
-                Array &arr = specificUpdates[transport];
-                arr.emplace_back(obj2.ref());
-            }
-            data2.emplace_back(std::move(obj2));
-        } else {
-            data.emplace_back(std::move(obj2));
+        if (properties.empty() && dropped > 0) {
+            dropObject(objectId);
+            continue;
         }
+        addUpdate(objectId, std::move(sigs), std::move(properties));
     }
 
-    for (auto & it : pendingPropertyUpdates2_) {
+    for (auto & it : propertyUpdates) {
         const Object *object = it.first;
         const MetaObject *const metaObject = channel_->metaObject(object);
         const std::string objectId = mapValue(objectIds_, object);
-        // maps property name to current property value
-        Map properties;
+        // maps property index to current property value
+        IntMap properties;
+        dropped = 0;
         for (size_t propertyIndex : it.second) {
-            // TODO: can we get rid of the int <-> string conversions here?
             const MetaProperty &property = metaObject->property(propertyIndex);
             assert(property.isValid());
-            Value && v = wrapResult(property.read(object), nullptr, objectId);
-            properties[stringNumber(propertyIndex)] = std::move(v);
-        }
-        Map obj;
-        obj[KEY_OBJECT] = objectId;
-        obj[KEY_PROPERTIES] = std::move(properties);
-        Value obj2(std::move(obj));
-
-        // if the object is auto registered, just send the update only to clients which know this object
-        if (mapContains(wrappedObjects_, objectId)) {
-            for (Transport *transport : mapValue(wrappedObjects_, objectId).transports) {
-                Array &arr = specificUpdates[transport];
-                arr.emplace_back(obj2.ref());
+            Value v = wrapResult(property.read(object), nullptr, objectId);
+            if (dropUnchanged && !propertyValueChanged(object, propertyIndex, v, sentSize)) {
+                drop(propertyIndex);
+                continue;
             }
-            data2.emplace_back(std::move(obj2));
-        } else {
-            data.emplace_back(std::move(obj2));
+            properties[static_cast<int>(propertyIndex)] = std::move(v);
+        }
+        if (properties.empty() && dropped > 0) {
+            dropObject(objectId);
+            continue;
         }
+        addUpdate(objectId, Value(), std::move(properties));
     }
 
-    Message message;
-    message[KEY_TYPE] = TypePropertyUpdate;
+    bool broadcastEmpty = broadcast.data.empty() && broadcast.compact.empty();
+    if (broadcastEmpty && broadcastDropped)
+        ++updateSavings_.messages;
+    for (Transport *transport : specificDropped) {
+        if (!specificUpdates.count(transport))
+            ++updateSavings_.messages;
+    }
 
     // data does not contain specific updates
-    if (!data.empty()) {
-        setClientIsIdle(false);
-
-        message[KEY_DATA] = std::move(data);
-        broadcastMessage(std::move(message));
+    if (!broadcastEmpty) {
+        Value data(std::move(broadcast.data));
+        Value compact(std::move(broadcast.compact));
+        sendMessage(transports, [&](auto & message) {
+            initMessage(message, TypePropertyUpdate);
+            setMessageField(message, KEY_DATA, envelopeData(message, data, compact).share());
+        });
+        for (Transport *transport : transports)
+            consumeCredit(transport);
     }
 
     // send every property update which is not supposed to be broadcasted
-    std::map<Transport*, Array>::iterator suend = specificUpdates.end();
-    for (std::map<Transport*, Array>::iterator it = specificUpdates.begin(); it != suend; ++it) {
-        message[KEY_DATA] = std::move(it->second);
-        it->first->sendMessage(std::move(message));
+    for (auto & it : specificUpdates) {
+        Value data(std::move(it.second.data));
+        Value compact(std::move(it.second.compact));
+        it.first->send([&](auto & message) {
+            initMessage(message, TypePropertyUpdate);
+            setMessageField(message, KEY_DATA, std::move(envelopeData(message, data, compact)));
+        });
+        consumeCredit(it.first);
     }
+    return values;
+}
 
-    pendingPropertyUpdates_.clear();
-    pendingPropertyUpdates2_.clear();
+bool Publisher::propertyValueChanged(const Object *object, size_t propertyIndex, Value &value, size_t &sentSize)
+{
+    size_t hash = value.hash();
+    auto r = sentPropertyValues_[object].emplace(propertyIndex, SentValue{hash, 0, Value()});
+    SentValue &sent = r.first->second;
+    if (!r.second && sent.hash == hash && sent.value == value) {
+        sentSize = sent.size;
+        return false;
+    }
+    sent.hash = hash;
+    sent.size = jsonSize(value);
+    // owned values are shared with the message, references may change later and are copied
+    sent.value = value.share();
+    if (!sent.value.isShared())
+        sent.value = value.clone();
+    return true;
 }
 
 void Publisher::invokeMethod(Object * object, size_t methodIndex, Array &&args, MetaMethod::Response const & resp)
@@ -352,29 +756,36 @@ void Publisher::setProperty(Object *object, size_t propertyIndex, Value &&value)
 
 void Publisher::signalEmitted(const Object *object, size_t signalIndex, Array &&arguments)
 {
+    if (initSnapshot_.type() != Value::None
+            && mapContains(mapValue(signalToPropertyMap_, object), signalIndex)) {
+        initSnapshotStale_.insert(object);
+    }
     if (!channel_ || channel_->transports_.empty()) {
         if (signalIndex == 0)
             objectDestroyed(object);
         return;
     }
     if (!mapContains(mapValue(signalToPropertyMap_, object), signalIndex)) {
-        Message message;
         const std::string &objectName = mapValue(objectIds_, object);
         assert(!objectName.empty());
-        message[KEY_OBJECT] = objectName;
-        message[KEY_SIGNAL] = static_cast<int>(signalIndex);
+        Value id(objectName);
+        Value args;
         if (!arguments.empty()) {
-            message[KEY_ARGS] = wrapList(arguments, nullptr, objectName);
+            args = wrapList(arguments, nullptr, objectName);
         }
-        message[KEY_TYPE] = TypeSignal;
+        auto build = [&](auto & message) {
+            initMessage(message, TypeSignal);
+            setMessageField(message, KEY_OBJECT, id.share());
+            setMessageField(message, KEY_SIGNAL, static_cast<int>(signalIndex));
+            if (args.type() != Value::None)
+                setMessageField(message, KEY_ARGS, args.share());
+        };
 
         // if the object is wrapped, just send the response to clients which know this object
         if (mapContains(wrappedObjects_, objectName)) {
-            for (Transport *transport : mapValue(wrappedObjects_, objectName).transports) {
-                transport->sendMessage(std::move(message));
-            }
+            sendMessage(mapValue(wrappedObjects_, objectName).transports, build);
         } else {
-            broadcastMessage(std::move(message));
+            broadcastMessage(build);
         }
 
         if (signalIndex == 0) {
@@ -382,9 +793,10 @@ void Publisher::signalEmitted(const Object *object, size_t signalIndex, Array &&
         }
     } else {
         pendingPropertyUpdates_[object][signalIndex] = std::move(arguments);
-        if (clientIsIdle_ && !blockUpdates_) {
-            channel_->startTimer(PROPERTY_UPDATE_INTERVAL);
-        }
+        int interval = INT_MAX;
+        for (size_t propertyIndex : mapValue(mapValue(signalToPropertyMap_, object), signalIndex))
+            interval = std::min(interval, scheduler_->interval(object, propertyIndex));
+        schedule(object, interval);
     }
 }
 
@@ -392,11 +804,25 @@ void Publisher::objectDestroyed(const Object *object)
 {
     const std::string &id = mapTake(objectIds_, object);
     assert(!id.empty());
-    bool removed = registeredObjects_.erase(id)
+    bool registered = registeredObjects_.erase(id);
+    bool removed = registered
             || wrappedObjects_.erase(id);
     assert(removed);
     (void)(removed);
 
+    if (initSnapshot_.type() != Value::None) {
+        if (initSnapshotWrapped_.count(id)) {
+            // still referenced by the property values of other objects
+            resetInitSnapshot();
+        } else if (registered) {
+            Map empty;
+            initSnapshot_.toMap(empty).erase(id);
+            initSnapshotJson_.toMap(empty).erase(id);
+            initSnapshotStale_.erase(object);
+            initSnapshotUnnotified_.erase(object);
+        }
+    }
+
     // only remove from handler when we initialized the property updates
     // cf: https://bugreports.qt.io/browse/QTBUG-60250
     if (propertyUpdatesInitialized_) {
@@ -404,6 +830,23 @@ void Publisher::objectDestroyed(const Object *object)
         signalToPropertyMap_.erase(object);
     }
     pendingPropertyUpdates_.erase(object);
+    pendingPropertyUpdates2_.erase(object);
+    pendingTimes_.erase(object);
+    scheduler_->objectDestroyed(object);
+    for (auto & client : clients_) {
+        client.second.pendingPropertyUpdates.erase(object);
+        client.second.pendingPropertyUpdates2.erase(object);
+    }
+    sentPropertyValues_.erase(object);
+
+    // the MetaObject may go with its last object, don't keep pointers into it
+    auto meta = objectMetas_.find(object);
+    if (meta != objectMetas_.end()) {
+        auto info = classInfos_.find(meta->second);
+        if (info != classInfos_.end() && --info->second.objects == 0)
+            classInfos_.erase(info);
+        objectMetas_.erase(meta);
+    }
 }
 
 Object *Publisher::unwrapObject(const std::string &objectId) const
@@ -430,6 +873,9 @@ Value Publisher::toVariant(Value &&value, int targetType) const
             warning("Cannot not convert non-object argument to Object*.", value);
         return unwrappedObject;
     }
+    // e.g. Long from the JSON parser for an int parameter
+    if (value.type() != targetType && value.canConvert(static_cast<Value::Type>(targetType)))
+        return std::move(value).convert(static_cast<Value::Type>(targetType));
     return std::move(value);
 }
 
@@ -452,6 +898,13 @@ void Publisher::transportRemoved(Transport *transport)
 
     transportedWrappedObjects_.erase(transport);
 
+    auto client = clients_.find(transport);
+    if (client != clients_.end()) {
+        if (client->second.credits > 0)
+            --readyClients_;
+        clients_.erase(client);
+    }
+
     for (Object *obj : objectsForDeletion)
         objectDestroyed(obj);
 }
@@ -532,15 +985,35 @@ void Publisher::deleteWrappedObject(Object *object) const
     //object->deleteLater();
 }
 
-void Publisher::broadcastMessage(Message &&message) const
+template<typename F>
+void Publisher::broadcastMessage(F const & build) const
 {
     if (channel_->transports_.empty()) {
-        warning("QWebChannel is not connected to any transports, cannot send message: %s", message);
+        warning("QWebChannel is not connected to any transports, cannot send message");
         return;
     }
 
-    for (Transport *transport : channel_->transports_) {
-        transport->sendMessage(std::move(message));
+    sendMessage(channel_->transports_, build);
+}
+
+template<typename F>
+void Publisher::sendMessage(std::vector<Transport*> const & transports, F const & build) const
+{
+    if (transports.size() == 1) {
+        transports.front()->send(build);
+        return;
+    }
+    // encode once per format, for the transports taking frames
+    Value frames[4];
+    for (Transport *transport : transports) {
+        if (!transport->takesFrames()) {
+            transport->send(build);
+            continue;
+        }
+        Value &frame = frames[transport->frameFormat()];
+        if (frame.type() == Value::None)
+            frame = transport->encodeFrame(build);
+        transport->postFrame(frame.share());
     }
 }
 
@@ -551,19 +1024,66 @@ void Publisher::handleMessage(Message &&message, Transport *transport)
         return;
     }
 
-    const MessageType type = toType(mapValue(message, KEY_TYPE));
-    if (type == TypeIdle) {
-        setClientIsIdle(true);
-    } else if (type == TypeInit) {
+    if (toType(mapValue(message, KEY_TYPE)) == TypeInit) {
         if (!mapContains(message, KEY_ID)) {
             warning("JSON message object is missing the id property: %s", message);
             return;
         }
-        transport->sendMessage(createResponse(std::move(mapValue(message, KEY_ID)), initializeClient(transport)));
+        // switch encodings after the response, if the client asked for them
+        bool binary = transport->supportsBinary()
+                && mapValue(message, KEY_CODEC).toStringView() == CODEC_BINARY;
+        bool compact = transport->supportsCompact()
+                && mapValue(message, KEY_ENVELOPE).toStringView() == ENVELOPE_COMPACT;
+        // our own clients unpack batches
+        bool batch = mapValue(message, KEY_BATCH).toBool();
+        // compress already the response, it's the largest message
+        bool compressed = transport->supportsCompression() && Compression::available()
+                && mapValue(message, KEY_COMPRESSION).toStringView() == COMPRESSION_DEFLATE;
+        Message response;
+        createResponse(response, std::move(mapValue(message, KEY_ID)), initializeClient(transport));
+        if (binary)
+            response[KEY_CODEC] = CODEC_BINARY;
+        if (compact)
+            response[KEY_ENVELOPE] = ENVELOPE_COMPACT;
+        if (batch)
+            response[KEY_BATCH] = true;
+        if (compressed)
+            response[KEY_COMPRESSION] = COMPRESSION_DEFLATE;
+        transport->flush();
+        transport->setCompressed(compressed);
+        transport->sendMessage(std::move(response));
+        transport->setBinary(binary);
+        transport->setCompact(compact);
+        transport->setBatch(batch);
+        return;
+    }
+    handle(message, transport);
+}
+
+void Publisher::handleMessage(CompactMessage &&message, Transport *transport)
+{
+    handle(message, transport);
+}
+
+template<typename M>
+void Publisher::handle(M &message, Transport *transport)
+{
+    const MessageType type = messageType(message);
+    if (type == TypeIdle) {
+        // one credit from clients not sending any
+        const Value &credits = messageField(message, KEY_DATA);
+        if (credits.type() == Value::None) {
+            grantCredits(transport, 1);
+        } else if (credits.type() == Value::Int || credits.type() == Value::Long) {
+            long long count = credits.toLong();
+            grantCredits(transport, count > INT_MAX ? INT_MAX : count < 0 ? 0 : static_cast<int>(count));
+        } else {
+            warning("Ignoring invalid credits for property updates:", credits);
+        }
     } else if (type == TypeDebug) {
-        warning("DEBUG: ", mapValue(message, KEY_DATA));
-    } else if (mapContains(message, KEY_OBJECT)) {
-        const std::string &objectName = mapValue(message, KEY_OBJECT).toString();
+        warning("DEBUG: ", messageField(message, KEY_DATA));
+    } else if (hasMessageField(message, KEY_OBJECT)) {
+        const std::string &objectName = messageField(message, KEY_OBJECT).toString();
         Object *object = mapValue(registeredObjects_, objectName);
         if (!object)
             object = mapValue(wrappedObjects_, objectName).object;
@@ -574,7 +1094,7 @@ void Publisher::handleMessage(Message &&message, Transport *transport)
         }
 
         if (type == TypeInvokeMethod) {
-            if (!mapContains(message, KEY_ID)) {
+            if (!hasMessageField(message, KEY_ID)) {
                 warning("JSON message object is missing the id property: %s", message);
                 return;
             }
@@ -584,33 +1104,35 @@ void Publisher::handleMessage(Message &&message, Transport *transport)
             Value args;
             Array args2;
             invokeMethod(object,
-                         static_cast<size_t>(mapValue(message, KEY_METHOD).toInt(-1)),
-                         std::move(mapValue(message, KEY_ARGS).toArray(args2)), [this, transport, &message] (Value && result) {
+                         static_cast<size_t>(messageField(message, KEY_METHOD).toInt(-1)),
+                         std::move(messageField(message, KEY_ARGS).toArray(args2)), [this, transport, &message] (Value && result) {
                 //if (!publisherExists || !transportExists)
                 //    return;
-                transport->sendMessage(createResponse(std::move(mapValue(message, KEY_ID)),
-                                                      wrapResult(std::move(result), transport)));
+                Value data = wrapResult(std::move(result), transport);
+                transport->send([&](auto & response) {
+                    createResponse(response, std::move(messageField(message, KEY_ID)), std::move(data));
+                });
             });
         } else if (type == TypeConnectToSignal) {
-            signalHandler_.connectTo(object, static_cast<size_t>(mapValue(message, KEY_SIGNAL).toInt(-1)));
+            signalHandler_.connectTo(object, static_cast<size_t>(messageField(message, KEY_SIGNAL).toInt(-1)));
         } else if (type == TypeDisconnectFromSignal) {
-            signalHandler_.disconnectFrom(object, static_cast<size_t>(mapValue(message, KEY_SIGNAL).toInt(-1)));
+            signalHandler_.disconnectFrom(object, static_cast<size_t>(messageField(message, KEY_SIGNAL).toInt(-1)));
         } else if (type == TypeSetProperty) {
-            setProperty(object, static_cast<size_t>(mapValue(message, KEY_PROPERTY).toInt(-1)),
-                        std::move(mapValue(message, KEY_VALUE)));
+            setProperty(object, static_cast<size_t>(messageField(message, KEY_PROPERTY).toInt(-1)),
+                        std::move(messageField(message, KEY_VALUE)));
         }
     }
 }
 
 void Publisher::propertyChanged(const Object *object, size_t propertyIndex)
 {
+    if (initSnapshot_.type() != Value::None)
+        initSnapshotStale_.insert(object);
     if (!channel_ || channel_->transports_.empty()) {
         return;
     }
     pendingPropertyUpdates2_[object].insert(propertyIndex);
-    if (clientIsIdle_ && !blockUpdates_) {
-        channel_->startTimer(PROPERTY_UPDATE_INTERVAL);
-    }
+    schedule(object, scheduler_->interval(object, propertyIndex));
 }
 
 void Publisher::setBlockUpdates(bool block)
@@ -624,6 +1146,7 @@ void Publisher::setBlockUpdates(bool block)
         sendPendingPropertyUpdates();
     } else {
         channel_->stopTimer();
+        timerActive_ = false;
     }
 
     //blockUpdatesChanged(block);
@@ -3,10 +3,14 @@
 
 #include "core/value.h"
 #include "core/metaobject.h"
+#include "core/channel.h"
 #include "signalhandler.h"
 #include "core/message.h"
+#include "core/updatescheduler.h"
 
+#include <chrono>
 #include <set>
+#include <map>
 
 // NOTE: keep in sync with corresponding maps in Bridge.js and WebChannelTest.qml
 
@@ -33,28 +37,88 @@ public:
     void registerObject(const std::string &id, Object *object);
 
     /**
-     * Send the given message to all known transports.
+     * Send the message built by @p build to all known transports.
+     *
+     * @p build is called for every transport with an empty Message or CompactMessage,
+     * depending on the negotiated envelope. Share the values put in the message.
      */
-    void broadcastMessage(Message &&message) const;
+    template<typename F>
+    void broadcastMessage(F const & build) const;
+
+    /**
+     * Send the message built by @p build to @p transports, as in broadcastMessage().
+     *
+     * Transports taking frames get the message encoded once for all of the same format.
+     */
+    template<typename F>
+    void sendMessage(std::vector<Transport*> const & transports, F const & build) const;
 
     /**
      * Serialize the QMetaObject of @p object and return it in JSON form.
      */
     Map classInfoForObject(Object const *object, Transport *transport);
 
+    // Class information without the property values, shared by all objects of a MetaObject
+    struct ClassInfo
+    {
+        struct Property
+        {
+            MetaProperty const *property;
+            Key name;
+            Value signalInfo;
+        };
+        Key className;
+        Value signals;
+        Value methods;
+        Value enums;
+        std::vector<Property> properties;
+        // some property is neither constant nor notified, values are read for every client
+        bool unnotified = false;
+        // objects described with it, it is dropped with the last one
+        size_t objects = 0;
+    };
+
     /**
-     * Set the client to idle or busy, based on the value of @p isIdle.
+     * Return the class information of @p metaObject, built on first use.
      *
-     * When the value changed, start/stop the property update timer accordingly.
+     * It is kept until the last object of @p metaObject is destroyed.
+     */
+    ClassInfo &classInfo(MetaObject const *metaObject);
+
+    /**
+     * Allow @p transport @p credits more property update messages, as acknowledged by its client.
+     *
+     * When the client had none left, start the property update timer. Credits below 1
+     * or of unknown transports are ignored, the sum saturates.
+     */
+    void grantCredits(Transport *transport, int credits);
+
+    /**
+     * Count a property update message sent to @p transport against its credits.
      */
-    void setClientIsIdle(bool isIdle);
+    void consumeCredit(Transport *transport);
 
     /**
      * Initialize clients by sending them the class information of the registered objects.
      *
      * Furthermore, if that was not done already, connect to their property notify signals.
+     *
+     * The class information is built once and kept as a snapshot, later clients get it
+     * shared. Only objects registered or changed since then, or with properties without
+     * notify signal, are read again. Clients without the binary encoding get it as JSON,
+     * which is encoded once.
+     */
+    Value initializeClient(Transport *transport);
+
+    /**
+     * Ids of the wrapped objects that @p transport has access to.
+     */
+    std::set<std::string> wrappedObjectIds(Transport *transport) const;
+
+    /**
+     * Drop the snapshot of the class information, it is built again for the next client.
      */
-    Map initializeClient(Transport *transport);
+    void resetInitSnapshot();
 
     /**
      * Go through all properties of the given object and connect to their notify signal.
@@ -71,10 +135,32 @@ public:
      * The list of signals as well as the arguments they contained, are also transmitted to
      * the remote clients.
      *
+     * Clients without credits keep the updates, merged with later ones, until they get credits.
+     *
      * @sa timer, initializePropertyUpdates
      */
     void sendPendingPropertyUpdates();
 
+    /**
+     * Send the pending updates of @p object after @p interval msec at the latest.
+     */
+    void schedule(Object const *object, int interval);
+
+    /**
+     * Have timerEvent() called at @p due, unless it is called earlier already.
+     *
+     * Only while updates are not blocked and some client has credits.
+     */
+    void startUpdateTimer(std::chrono::steady_clock::time_point due);
+
+    /**
+     * Whether @p value of property @p propertyIndex differs from the value last sent to the clients.
+     *
+     * Changed values are remembered as the last sent ones, sharing @p value when possible.
+     * For unchanged ones, @p sentSize is set to the estimated JSON size of the value.
+     */
+    bool propertyValueChanged(Object const *object, size_t propertyIndex, Value &value, size_t &sentSize);
+
     /**
      * Invoke the method of index @p methodIndex on @p object with the arguments @p args.
      *
@@ -145,11 +231,17 @@ public:
      */
     void handleMessage(Message &&message, Transport *transport);
 
+    void handleMessage(CompactMessage &&message, Transport *transport);
+
     void propertyChanged(Object const * object, size_t propertyIndex);
 
 protected:
     void timerEvent();
 
+private:
+    template<typename M>
+    void handle(M &message, Transport *transport);
+
 private:
     friend class Channel;
     friend class Transport;
@@ -158,9 +250,6 @@ private:
     Channel * channel_;
     SignalHandler signalHandler_;
 
-    // true when the client is idle, false otherwise
-    bool clientIsIdle_;
-
     // true when no property updates should be sent, false otherwise
     bool blockUpdates_;
 
@@ -200,8 +289,25 @@ private:
     // Map of transports to wrapped object ids
     std::multimap<Transport*, std::string> transportedWrappedObjects_;
 
+    // MetaObject of the objects classInfoForObject() was called for
     std::unordered_map<const Object *, MetaObject const *> objectMetas_;
 
+    // Class information by MetaObject, classInfoForObject() only adds the property values.
+    // Keeps MetaProperty pointers, valid while some object of the MetaObject is alive.
+    std::unordered_map<MetaObject const *, ClassInfo> classInfos_;
+
+    // Snapshot of the class information of the registered objects, shared with initializing
+    // clients, and the same parsed from its JSON encoding, sent to clients without the
+    // binary encoding. Its members are written back verbatim.
+    Value initSnapshot_;
+    Value initSnapshotJson_;
+    // Registered objects added or with property changes since the snapshot was taken
+    std::set<Object const *> initSnapshotStale_;
+    // Registered objects in the snapshot with changes we are not notified of
+    std::set<Object const *> initSnapshotUnnotified_;
+    // Objects wrapped for the property values in the snapshot, initialized clients get access
+    std::set<std::string> initSnapshotWrapped_;
+
     // Map of objects to maps of signal indices to a set of all their property indices.
     // The last value is a set as a signal can be the notify signal of multiple properties.
     typedef std::unordered_map<size_t, std::set<size_t> > SignalToPropertyNameMap;
@@ -213,7 +319,62 @@ private:
     typedef std::unordered_map<Object const *, SignalToArgumentsMap> PendingPropertyUpdates;
     PendingPropertyUpdates pendingPropertyUpdates_;
 
-    std::unordered_map<Object const *, std::set<size_t> > pendingPropertyUpdates2_;
+    typedef std::unordered_map<Object const *, std::set<size_t> > PendingPropertyUpdates2;
+    PendingPropertyUpdates2 pendingPropertyUpdates2_;
+
+    // Flow control of a client, it acknowledges property updates with TypeIdle messages
+    struct ClientState
+    {
+        // property update messages the client accepts before the next acknowledgement
+        int credits = 0;
+        // updates kept while the client had no credits, the property values are read when sent
+        PendingPropertyUpdates pendingPropertyUpdates;
+        PendingPropertyUpdates2 pendingPropertyUpdates2;
+    };
+    std::unordered_map<Transport *, ClientState> clients_;
+    // clients with credits left
+    size_t readyClients_ = 0;
+
+    /**
+     * Send the current values of the properties in @p signalUpdates and @p propertyUpdates
+     * to @p transports, wrapped objects only to the transports that know them.
+     *
+     * With @p dropUnchanged, values equal to the ones last sent are left out. Returns the
+     * number of values sent. The signal arguments in @p signalUpdates get shared.
+     */
+    size_t sendPropertyUpdates(PendingPropertyUpdates &signalUpdates,
+                             PendingPropertyUpdates2 const &propertyUpdates,
+                             std::vector<Transport*> const &transports, bool dropUnchanged);
+
+    // Fingerprint of the property values last sent to the clients, to drop updates of unchanged values.
+    // Forgotten when the values are read for the class information of a client.
+    struct SentValue
+    {
+        size_t hash;
+        // estimated JSON size, counted for dropped updates
+        size_t size;
+        Value value;
+    };
+    std::unordered_map<Object const *, std::unordered_map<size_t, SentValue> > sentPropertyValues_;
+
+    Channel::UpdateSavings updateSavings_;
+
+    UpdateScheduler defaultScheduler_;
+    UpdateScheduler *scheduler_ = &defaultScheduler_;
+
+    // When the pending updates of an object were first changed and are due to be sent
+    struct PendingTime
+    {
+        std::chrono::steady_clock::time_point since;
+        std::chrono::steady_clock::time_point due;
+    };
+    std::unordered_map<Object const *, PendingTime> pendingTimes_;
+
+    // The host timer is started for timerDue_
+    bool timerActive_ = false;
+    std::chrono::steady_clock::time_point timerDue_;
+
+    Channel::UpdateMetrics updateMetrics_;
 
     // Aggregate property updates since we get multiple Qt.idle message when we have multiple
     // clients. They all share the same QWebProcess though so we must take special care to
@@ -3,6 +3,31 @@
 #include "collection.h"
 #include "debug.h"
 #include "core/transport.h"
+#include "core/compression.h"
+
+#include <stdlib.h>
+
+namespace {
+
+    // Signals and properties of a property update, maps with decimal keys
+    //  from JSON are moved into an IntMap
+    IntMap & indexMap(Value & value, IntMap & dft)
+    {
+        if (value.isMap()) {
+            Map emptyMap;
+            Map & map = value.toMap(emptyMap);
+            IntMap indices;
+            indices.reserve(map.size());
+            for (auto & e : map)
+                indices.emplace(atoi(e.first.c_str()), std::move(e.second));
+            value = std::move(indices);
+        }
+        return value.toIntMap(dft);
+    }
+
+    // Property update messages the publisher may send ahead of our acknowledgements
+    const int PROPERTY_UPDATE_CREDITS = 4;
+}
 
 Receiver::Receiver(Channel * channel, Transport *transport)
     : channel_(channel)
@@ -23,32 +48,98 @@ void Receiver::handleMessage(Message &&message)
         return;
     }
 
-    const MessageType type = toType(mapValue(message, KEY_TYPE));
+    if (toType(mapValue(message, KEY_TYPE)) == TypeResponse) {
+        // the init response accepts the encodings we offered
+        if (mapValue(message, KEY_CODEC).toStringView() == CODEC_BINARY)
+            transport_->setBinary(true);
+        if (mapValue(message, KEY_ENVELOPE).toStringView() == ENVELOPE_COMPACT)
+            transport_->setCompact(true);
+        if (mapValue(message, KEY_BATCH).toBool())
+            transport_->setBatch(true);
+        if (mapValue(message, KEY_COMPRESSION).toStringView() == COMPRESSION_DEFLATE)
+            transport_->setCompressed(true);
+    }
+    handle(message);
+}
+
+void Receiver::handleMessage(CompactMessage &&message)
+{
+    handle(message);
+}
+
+template<typename M>
+void Receiver::handle(M &message)
+{
+    const MessageType type = messageType(message);
     if (type == TypeResponse) {
-        if (!mapContains(message, KEY_ID)) {
+        if (!hasMessageField(message, KEY_ID)) {
             warning("JSON message object is missing the id property: %s", message);
             return;
         }
-        response(mapValue(message, KEY_ID).toString(), std::move(mapValue(message, KEY_DATA)));
-    } else if (mapContains(message, KEY_OBJECT)) {
-        const std::string &objectName = mapValue(message, KEY_OBJECT).toString();
+        response(messageField(message, KEY_ID).toString(), std::move(messageField(message, KEY_DATA)));
+    } else if (type == TypePropertyUpdate) {
+        Array empty;
+        for (Value & update : messageField(message, KEY_DATA).toArray(empty))
+            propertyUpdate(update);
+        idle(1);
+    } else if (hasMessageField(message, KEY_OBJECT)) {
+        const std::string &objectName = messageField(message, KEY_OBJECT).toString();
         ProxyObject *object = mapValue(objects_, objectName);
         if (!object) {
             warning("Unknown object encountered", objectName);
             return;
         }
-        if (type == TypePropertyUpdate) {
-
-        } else if (type == TypeSignal) {
-            size_t signalIndex = static_cast<size_t>(mapValue(message, KEY_SIGNAL).toInt());
+        if (type == TypeSignal) {
+            size_t signalIndex = static_cast<size_t>(messageField(message, KEY_SIGNAL).toInt());
             Array empty;
-            Array & args = mapValue(message, KEY_ARGS).toArray(empty);
-            MetaObject::Signal signal(object, signalIndex);
-            for (auto & conn : connections_) {
-                if (signal == conn) {
-                    conn.signal(std::move(args));
-                }
-            }
+            signalEmitted(object, signalIndex, std::move(messageField(message, KEY_ARGS).toArray(empty)));
+        }
+    }
+}
+
+void Receiver::propertyUpdate(Value &update)
+{
+    // [object, signals, properties] in the compact envelope
+    Value * object;
+    Value * sigs;
+    Value * properties;
+    Array emptyArray;
+    Map emptyMap;
+    if (update.isArray()) {
+        Array & fields = update.toArray(emptyArray);
+        if (fields.size() < 3) {
+            warning("Invalid property update encountered:", update);
+            return;
+        }
+        object = &fields[0];
+        sigs = &fields[1];
+        properties = &fields[2];
+    } else {
+        Map & fields = update.toMap(emptyMap);
+        object = &mapValue(fields, KEY_OBJECT);
+        sigs = &mapValue(fields, KEY_SIGNALS);
+        properties = &mapValue(fields, KEY_PROPERTIES);
+    }
+
+    const std::string &objectName = object->toString();
+    ProxyObject *proxy = mapValue(objects_, objectName);
+    if (!proxy) {
+        warning("Unknown object encountered", objectName);
+        return;
+    }
+    IntMap empty;
+    for (auto & p : indexMap(*properties, empty))
+        proxy->updateProperty(static_cast<size_t>(p.first), std::move(p.second));
+    for (auto & s : indexMap(*sigs, empty))
+        signalEmitted(proxy, static_cast<size_t>(s.first), std::move(s.second.toArray(emptyArray)));
+}
+
+void Receiver::signalEmitted(ProxyObject *object, size_t signalIndex, Array &&args)
+{
+    MetaObject::Signal signal(object, signalIndex);
+    for (auto & conn : connections_) {
+        if (signal == conn) {
+            conn.signal(std::move(args));
         }
     }
 }
@@ -57,7 +148,15 @@ void Receiver::init(Response const & response)
 {
     Message message;
     message[KEY_TYPE] = TypeInit;
-    sendMessage(std::move(message), [this, response](Value && data) {
+    if (transport_->supportsBinary())
+        message[KEY_CODEC] = CODEC_BINARY;
+    if (transport_->supportsCompact())
+        message[KEY_ENVELOPE] = ENVELOPE_COMPACT;
+    // batches are unpacked by Transport::messageReceived
+    message[KEY_BATCH] = true;
+    if (transport_->supportsCompression() && Compression::available())
+        message[KEY_COMPRESSION] = COMPRESSION_DEFLATE;
+    message[KEY_ID] = request([this, response](Value && data) {
         Map emptyMap;
         Map & objectInfos = data.toMap(emptyMap);
         for (auto & o : objectInfos) {
@@ -66,23 +165,36 @@ void Receiver::init(Response const & response)
             o.second = unwrapObject(std::move(objectInfo));
         }
         response(std::move(data));
+        idle(PROPERTY_UPDATE_CREDITS);
+    });
+    transport_->sendMessage(std::move(message));
+}
+
+void Receiver::idle(int credits)
+{
+    transport_->send([&](auto & message) {
+        initMessage(message, TypeIdle);
+        if (credits != 1)
+            setMessageField(message, KEY_DATA, credits);
     });
 }
 
 bool Receiver::invokeMethod(ProxyObject *object, size_t methodIndex, Array &&args, Response const & response)
 {
-    Message message;
-    message[KEY_TYPE] = TypeInvokeMethod;
-    message[KEY_OBJECT] = object->id();
-    message[KEY_METHOD] = static_cast<int>(methodIndex);
-    message[KEY_ARGS] = std::move(args);
-    sendMessage(std::move(message), [this, response](Value && data) {
+    std::string id = request([this, response](Value && data) {
         if (mapValue(data.toMap(), KEY_Object).toBool()) {
             Map emptyMap;
             data = unwrapObject(std::move(data.toMap(emptyMap)));
         }
         response(std::move(data));
     });
+    transport_->send([&](auto & message) {
+        initMessage(message, TypeInvokeMethod);
+        setMessageField(message, KEY_ID, std::move(id));
+        setMessageField(message, KEY_OBJECT, object->id());
+        setMessageField(message, KEY_METHOD, static_cast<int>(methodIndex));
+        setMessageField(message, KEY_ARGS, std::move(args));
+    });
     return true;
 }
 
@@ -96,11 +208,11 @@ bool Receiver::connectToSignal(const MetaObject::Connection &conn)
     connections_.emplace_back(conn);
     if (connections_.size() != 1)
         return true;
-    Message message;
-    message[KEY_TYPE] = TypeConnectToSignal;
-    message[KEY_ID] = static_cast<ProxyObject const *>(conn.object())->id();
-    message[KEY_SIGNAL] = static_cast<int>(conn.signalIndex());
-    transport_->sendMessage(std::move(message));
+    transport_->send([&](auto & message) {
+        initMessage(message, TypeConnectToSignal);
+        setMessageField(message, KEY_OBJECT, static_cast<ProxyObject const *>(conn.object())->id());
+        setMessageField(message, KEY_SIGNAL, static_cast<int>(conn.signalIndex()));
+    });
     return true;
 }
 
@@ -114,31 +226,30 @@ bool Receiver::disconnectFromSignal(const MetaObject::Connection &conn)
     connections_.erase(iter);
     if (!connections_.empty())
         return true;
-    Message message;
-    message[KEY_TYPE] = TypeDisconnectFromSignal;
-    message[KEY_ID] = static_cast<ProxyObject const *>(conn.object())->id();
-    message[KEY_SIGNAL] = static_cast<int>(conn.signalIndex());
-    transport_->sendMessage(std::move(message));
+    transport_->send([&](auto & message) {
+        initMessage(message, TypeDisconnectFromSignal);
+        setMessageField(message, KEY_OBJECT, static_cast<ProxyObject const *>(conn.object())->id());
+        setMessageField(message, KEY_SIGNAL, static_cast<int>(conn.signalIndex()));
+    });
     return true;
 }
 
 bool Receiver::setProperty(ProxyObject *object, size_t propertyIndex, Value &&value)
 {
-    Message message;
-    message[KEY_TYPE] = TypeDisconnectFromSignal;
-    message[KEY_ID] = object->id();
-    message[KEY_PROPERTY] = static_cast<int>(propertyIndex);
-    message[KEY_VALUE] = std::move(value);
-    transport_->sendMessage(std::move(message));
+    transport_->send([&](auto & message) {
+        initMessage(message, TypeSetProperty);
+        setMessageField(message, KEY_OBJECT, object->id());
+        setMessageField(message, KEY_PROPERTY, static_cast<int>(propertyIndex));
+        setMessageField(message, KEY_VALUE, std::move(value));
+    });
     return true;
 }
 
-void Receiver::sendMessage(Message &&message, Response const & response)
+std::string Receiver::request(Response const & response)
 {
     std::string id = stringNumber(msgId_++);
-    message[KEY_ID] = id;
     responses_[id] = response;
-    transport_->sendMessage(std::move(message));
+    return id;
 }
 
 void Receiver::response(const std::string &id, Value &&result)
@@ -21,6 +21,8 @@ public:
      */
     void handleMessage(Message &&message);
 
+    void handleMessage(CompactMessage &&message);
+
 protected:
     friend class ProxyMetaProperty;
     friend class ProxyMetaMethod;
@@ -39,11 +41,29 @@ protected:
     bool setProperty(ProxyObject *object, size_t propertyIndex, Value &&value);
 
 protected:
-    void sendMessage(Message &&message, Response const & response);
+    /**
+     * Remember @p response for a new request and return the id of the request.
+     */
+    std::string request(Response const & response);
 
     void response(std::string const & id, Value && result);
 
 private:
+    template<typename M>
+    void handle(M &message);
+
+    /**
+     * Apply the new property values of one object in @p update, then emit its notify signals.
+     */
+    void propertyUpdate(Value &update);
+
+    void signalEmitted(ProxyObject *object, size_t signalIndex, Array &&args);
+
+    /**
+     * Acknowledge property updates, allowing the publisher @p credits more of them.
+     */
+    void idle(int credits);
+
     Array unwrapList(Array &list);
 
     Value unwrapResult(Value &&result);
@@ -12,6 +12,6 @@ std::pair<Transport*, Transport*> PairedTransport::createTransports()
 
 void PairedTransport::sendMessage(Message &&message)
 {
-    std::cout << message << std::endl;
+    std::cout << serialize(message) << std::endl;
     anothor_->messageReceived(std::move(message));
 }